@@ -0,0 +1,222 @@
+#ifndef UNTITLED7_BATCHEVAL_H
+#define UNTITLED7_BATCHEVAL_H
+
+#include <cstdint>
+#include <vector>
+#include "ChessBoard.cpp"
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Positions stored structure-of-arrays: one vector per piece bitboard, in zobrist index order
+// (white pawn..king, then black pawn..king), so a SIMD load picks up the same bitboard of 4 positions.
+struct PositionBatch {
+    std::vector<uint64_t> pieces[12];
+
+    size_t size() const {
+        return pieces[0].size();
+    }
+
+    void clear() {
+        for (auto &bitboards: pieces) bitboards.clear();
+    }
+
+    void reserve(size_t count) {
+        for (auto &bitboards: pieces) bitboards.reserve(count);
+    }
+
+    void add(const uint64_t bitboards[12]) {
+        for (int i = 0; i < 12; i++) pieces[i].push_back(bitboards[i]);
+    }
+
+    void add(const ChessBoard &board) {
+        const uint64_t bitboards[12] = {board.whitePawns, board.whiteKnights, board.whiteBishops, board.whiteRooks,
+                                        board.whiteQueens, board.whiteKing, board.blackPawns, board.blackKnights,
+                                        board.blackBishops, board.blackRooks, board.blackQueens, board.blackKing};
+        add(bitboards);
+    }
+};
+
+// The material, PST and pawn structure terms of the classical eval, white minus black:
+//   material[white] - material[black] + taperedScore(PST[white] - PST[black] + pawnStructureScore())
+// for whole batches of positions without a ChessBoard per position. The AVX2 path evaluates 4
+// positions per vector; the PST sums come from per-rank tables, 8 lookups per bitboard instead of a
+// lookup per piece.
+class BatchEvaluator {
+public:
+    BatchEvaluator() : rankTables(12 * 8 * 256) {
+        for (int pieceIndex = 0; pieceIndex < 12; pieceIndex++) {
+            auto pieceType = static_cast<ChessBoard::PieceType>(pieceIndex % 6);
+            bool white = pieceIndex < 6;
+            for (int rank = 0; rank < 8; rank++) {
+                for (int bits = 0; bits < 256; bits++) {
+                    int score = 0;
+                    for (int file = 0; file < 8; file++) {
+                        if (bits & (1 << file)) {
+                            score += ChessBoard::getPositionalValue(pieceType, rank * 8 + file, white);
+                        }
+                    }
+                    rankTables[(pieceIndex * 8 + rank) * 256 + bits] = white ? score : -score;
+                }
+            }
+        }
+    }
+
+    // scores[i] receives position i's white relative score
+    void evaluate(const PositionBatch &batch, int *scores) const {
+        size_t i = 0;
+#ifdef __AVX2__
+        for (; i + 4 <= batch.size(); i += 4) {
+            evaluateFour(batch, i, scores + i);
+        }
+#endif
+        for (; i < batch.size(); i++) {
+            scores[i] = evaluateOne(batch, i);
+        }
+    }
+
+    // The plain C++ path, also used for the tail of a batch that doesn't fill a vector
+    int evaluateOne(const PositionBatch &batch, size_t index) const {
+        uint64_t bitboards[12];
+        for (int i = 0; i < 12; i++) bitboards[i] = batch.pieces[i][index];
+
+        int material = 0;
+        int packed = ChessBoard::pawnStructureFor(bitboards[0], bitboards[6], true)
+                     - ChessBoard::pawnStructureFor(bitboards[6], bitboards[0], false);
+        for (int pieceIndex = 0; pieceIndex < 12; pieceIndex++) {
+            int count = __builtin_popcountll(bitboards[pieceIndex]);
+            material += (pieceIndex < 6 ? count : -count) * pieceValues[pieceIndex % 6];
+            for (int rank = 0; rank < 8; rank++) {
+                packed += rankTables[(pieceIndex * 8 + rank) * 256 + ((bitboards[pieceIndex] >> (rank * 8)) & 0xFF)];
+            }
+        }
+        int phase = __builtin_popcountll(bitboards[1] | bitboards[2] | bitboards[7] | bitboards[8])
+                    + 2 * __builtin_popcountll(bitboards[3] | bitboards[9])
+                    + 4 * __builtin_popcountll(bitboards[4] | bitboards[10]);
+        return material + tapered(packed, phase);
+    }
+
+private:
+    std::vector<int> rankTables; // [pieceIndex][rank][byte], packed PST sums, negated for black
+    static constexpr int pieceValues[6] = {ChessBoard::pawnValue, ChessBoard::knightValue, ChessBoard::bishopValue,
+                                           ChessBoard::rookValue, ChessBoard::queenValue, 0};
+
+    static int tapered(int packed, int phase) {
+        phase = std::min(phase, static_cast<int>(ChessBoard::maxGamePhase));
+        return (middlegameScore(packed) * phase + endgameScore(packed) * (ChessBoard::maxGamePhase - phase))
+               / ChessBoard::maxGamePhase;
+    }
+
+#ifdef __AVX2__
+    static __m256i load(const PositionBatch &batch, int pieceIndex, size_t index) {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(batch.pieces[pieceIndex].data() + index));
+    }
+
+    // Per 64-bit lane popcount from a nibble lookup, AVX2 has no vpopcntq
+    static __m256i popcount(__m256i v) {
+        const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i lowNibbles = _mm256_set1_epi8(0x0F);
+        __m256i low = _mm256_and_si256(v, lowNibbles);
+        __m256i high = _mm256_and_si256(_mm256_srli_epi16(v, 4), lowNibbles);
+        __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, low), _mm256_shuffle_epi8(lookup, high));
+        return _mm256_sad_epu8(counts, _mm256_setzero_si256());
+    }
+
+    // count * packed score in each lane; only the low 32 bits of a lane are meaningful
+    static __m256i scaled(__m256i counts, int packed) {
+        return _mm256_mul_epi32(counts, _mm256_set1_epi64x(packed));
+    }
+
+    static __m256i northFill(__m256i v) {
+        v = _mm256_or_si256(v, _mm256_slli_epi64(v, 8));
+        v = _mm256_or_si256(v, _mm256_slli_epi64(v, 16));
+        return _mm256_or_si256(v, _mm256_slli_epi64(v, 32));
+    }
+
+    static __m256i southFill(__m256i v) {
+        v = _mm256_or_si256(v, _mm256_srli_epi64(v, 8));
+        v = _mm256_or_si256(v, _mm256_srli_epi64(v, 16));
+        return _mm256_or_si256(v, _mm256_srli_epi64(v, 32));
+    }
+
+    // Shifts one file towards h (east) or a (west) without wrapping
+    static __m256i east(__m256i v) {
+        return _mm256_and_si256(_mm256_slli_epi64(v, 1), _mm256_set1_epi64x(ChessBoard::notAFile));
+    }
+
+    static __m256i west(__m256i v) {
+        return _mm256_and_si256(_mm256_srli_epi64(v, 1), _mm256_set1_epi64x(ChessBoard::notHFile));
+    }
+
+    static __m256i andNot(__m256i v, __m256i mask) {
+        return _mm256_andnot_si256(mask, v);
+    }
+
+    // ChessBoard::pawnStructureFor on 4 positions
+    static __m256i pawnStructureFor(__m256i own, __m256i enemy, bool white) {
+        __m256i fileFill = northFill(southFill(own));
+        __m256i neighbourFiles = _mm256_or_si256(east(fileFill), west(fileFill));
+
+        __m256i behindOwn = white ? _mm256_srli_epi64(southFill(own), 8) : _mm256_slli_epi64(northFill(own), 8);
+        __m256i score = scaled(popcount(_mm256_and_si256(own, behindOwn)), defaultEvalParams.doubledPawnPenalty);
+        score = _mm256_add_epi64(score, scaled(popcount(andNot(own, neighbourFiles)), defaultEvalParams.isolatedPawnPenalty));
+
+        __m256i ownForward = white ? _mm256_slli_epi64(own, 8) : _mm256_srli_epi64(own, 8);
+        __m256i enemyForward = white ? _mm256_srli_epi64(enemy, 8) : _mm256_slli_epi64(enemy, 8);
+        __m256i ownAttacks = _mm256_or_si256(east(ownForward), west(ownForward));
+        __m256i enemyAttacks = _mm256_or_si256(east(enemyForward), west(enemyForward));
+        __m256i ownAttackSpans = white ? northFill(ownAttacks) : southFill(ownAttacks);
+        __m256i backwardStops = andNot(_mm256_and_si256(ownForward, enemyAttacks), ownAttackSpans);
+        score = _mm256_add_epi64(score, scaled(popcount(backwardStops), defaultEvalParams.backwardPawnPenalty));
+
+        __m256i enemyFrontSpans = white ? _mm256_srli_epi64(southFill(enemy), 8) : _mm256_slli_epi64(northFill(enemy), 8);
+        enemyFrontSpans = _mm256_or_si256(enemyFrontSpans, _mm256_or_si256(east(enemyFrontSpans), west(enemyFrontSpans)));
+        __m256i passed = andNot(own, enemyFrontSpans);
+        for (int relativeRank = 1; relativeRank < 7; relativeRank++) {
+            int rank = white ? relativeRank : 7 - relativeRank;
+            __m256i onRank = _mm256_and_si256(passed, _mm256_set1_epi64x(static_cast<int64_t>(0xFFULL << (rank * 8))));
+            score = _mm256_add_epi64(score, scaled(popcount(onRank), defaultEvalParams.passedPawnBonus[relativeRank]));
+        }
+        return score;
+    }
+
+    void evaluateFour(const PositionBatch &batch, size_t index, int *scores) const {
+        __m256i whitePawns = load(batch, 0, index);
+        __m256i blackPawns = load(batch, 6, index);
+        __m256i packed = _mm256_sub_epi64(pawnStructureFor(whitePawns, blackPawns, true),
+                                          pawnStructureFor(blackPawns, whitePawns, false));
+        __m256i material = _mm256_setzero_si256();
+        __m256i minors = _mm256_setzero_si256(), rooks = _mm256_setzero_si256(), queens = _mm256_setzero_si256();
+        const __m256i byteMask = _mm256_set1_epi64x(0xFF);
+        for (int pieceIndex = 0; pieceIndex < 12; pieceIndex++) {
+            __m256i bitboards = load(batch, pieceIndex, index);
+            int value = pieceIndex < 6 ? pieceValues[pieceIndex % 6] : -pieceValues[pieceIndex % 6];
+            material = _mm256_add_epi64(material, scaled(popcount(bitboards), value));
+            const int *table = &rankTables[pieceIndex * 8 * 256];
+            for (int rank = 0; rank < 8; rank++) {
+                __m256i bytes = _mm256_and_si256(_mm256_srli_epi64(bitboards, rank * 8), byteMask);
+                __m128i pst = _mm256_i64gather_epi32(table + rank * 256, bytes, 4);
+                packed = _mm256_add_epi64(packed, _mm256_cvtepi32_epi64(pst));
+            }
+            int pieceType = pieceIndex % 6;
+            if (pieceType == ChessBoard::Knight || pieceType == ChessBoard::Bishop) minors = _mm256_or_si256(minors, bitboards);
+            if (pieceType == ChessBoard::Rook) rooks = _mm256_or_si256(rooks, bitboards);
+            if (pieceType == ChessBoard::Queen) queens = _mm256_or_si256(queens, bitboards);
+        }
+        __m256i phase = _mm256_add_epi64(popcount(minors), _mm256_add_epi64(
+                _mm256_slli_epi64(popcount(rooks), 1), _mm256_slli_epi64(popcount(queens), 2)));
+
+        alignas(32) int64_t packedLanes[4], materialLanes[4], phaseLanes[4];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(packedLanes), packed);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(materialLanes), material);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(phaseLanes), phase);
+        for (int lane = 0; lane < 4; lane++) {
+            scores[lane] = static_cast<int>(materialLanes[lane])
+                           + tapered(static_cast<int>(packedLanes[lane]), static_cast<int>(phaseLanes[lane]));
+        }
+    }
+#endif
+};
+
+#endif //UNTITLED7_BATCHEVAL_H
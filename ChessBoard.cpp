@@ -1,16 +1,37 @@
 //
 // Created by Henrik Ravnborg on 2024-03-09.
 //
+// Included directly by the other sources and tools, hence the guard
+#ifndef UNTITLED7_CHESSBOARD_CPP
+#define UNTITLED7_CHESSBOARD_CPP
+#include <atomic>
+#include <memory>
 #include <thread>
 #include <SFML/Graphics.hpp>
 #include <SFML/Graphics/RenderWindow.hpp>
 #include <SFML/Graphics/Sprite.hpp>
 #include <SFML/Graphics/Texture.hpp>
 #include <cstdint>
+#include <cstring>
 #include <algorithm>
 #include <iostream>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include "Nnue.h"
+#include "EvalParams.h"
+#include "Profiler.h"
+#include "Book.h"
+#include "Tablebase.h"
 using namespace std;
 
+// Search statistics cost a few increments per node; builds with NO_SEARCH_STATS compile them out
+#ifdef NO_SEARCH_STATS
+#define SEARCH_STAT(statement)
+#else
+#define SEARCH_STAT(statement) statement
+#endif
+
 static bool update = false;
 
 struct Move {
@@ -25,50 +46,213 @@ struct Move {
     bool whiteKing;          // Indicates if it's a white king in a castling move
     bool promotion;          // Indicates if the move is a pawn promotion
     int score;               // Score of the move for evaluation
+    uint64_t* promotedTo = nullptr; // Bitboard the pawn turns into on a promotion
+    bool enPassant = false;         // The captured pawn sits behind toSquare, not on it
+    // Filled in by movePiece so resetPreviousMove can restore them
+    int previousHalfmoveClock = 0;
+    int previousCastlingRights = 0;
+    uint64_t previousEnPassantSquare = 0;
 
     // Default constructor
-    Move() : pieceMoved(nullptr), fromSquare(0), toSquare(0), pieceCaptured(nullptr), capture(false), castle(false), kingToSquare(0), kingFromSquare(0), promotion(false), score(0) {}
+    Move() : pieceMoved(nullptr), fromSquare(0), toSquare(0), pieceCaptured(nullptr), capture(false), castle(false), kingToSquare(0), kingFromSquare(0), whiteKing(false), promotion(false), score(0) {}
 
     // Constructor for regular and capture moves
     Move(uint64_t* moved, uint64_t from, uint64_t to, uint64_t* captured = nullptr, bool cap = false, int moveScore = 0)
-            : pieceMoved(moved), fromSquare(from), toSquare(to), pieceCaptured(captured), capture(cap), castle(false), kingToSquare(0), kingFromSquare(0), promotion(false), score(moveScore) {}
+            : pieceMoved(moved), fromSquare(from), toSquare(to), pieceCaptured(captured), capture(cap), castle(false), kingToSquare(0), kingFromSquare(0), whiteKing(false), promotion(false), score(moveScore) {}
 
     // Constructor for castling moves
     Move(uint64_t* moved, uint64_t from, uint64_t to, bool cas, uint64_t kingTo, uint64_t kingFrom, bool whiteking, int moveScore = 0)
-            : pieceMoved(moved), fromSquare(from), toSquare(to), pieceCaptured(nullptr), capture(false), castle(cas), kingToSquare(kingTo), kingFromSquare(kingFrom), promotion(false), whiteKing(whiteking), score(moveScore) {}
+            : pieceMoved(moved), fromSquare(from), toSquare(to), pieceCaptured(nullptr), capture(false), castle(cas), kingToSquare(kingTo), kingFromSquare(kingFrom), whiteKing(whiteking), promotion(false), score(moveScore) {}
 
     // Constructor for pawn promotion moves
     Move(uint64_t* moved, uint64_t from, uint64_t to, uint64_t* captured = nullptr, bool cap = false, bool prom = true, int moveScore = 0)
-            : pieceMoved(moved), fromSquare(from), toSquare(to), pieceCaptured(captured), capture(cap), castle(false), kingToSquare(0), kingFromSquare(0), promotion(prom), score(moveScore) {}
+            : pieceMoved(moved), fromSquare(from), toSquare(to), pieceCaptured(captured), capture(cap), castle(false), kingToSquare(0), kingFromSquare(0), whiteKing(false), promotion(prom), score(moveScore) {}
+
+    // Same piece between the same squares, the score is ignored. Castling moves the rook between the same
+    // squares as a plain rook move, the flag tells them apart.
+    bool sameAs(const Move &other) const {
+        return pieceMoved == other.pieceMoved && fromSquare == other.fromSquare && toSquare == other.toSquare &&
+               promotedTo == other.promotedTo && castle == other.castle;
+    }
 };
 
 
+// Knight, king and ray attack sets by square (a1 = 0), built at compile time. The rays run
+// N, NE, E, NW, S, SW, W, SE: the first four towards higher squares, the last four towards lower ones.
+struct AttackTables {
+    uint64_t knight[64];
+    uint64_t king[64];
+    uint64_t rays[8][64];
+};
+
+constexpr AttackTables makeAttackTables() {
+    AttackTables tables{};
+    const int knightSteps[8][2] = {{1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}};
+    const int directions[8][2] = {{0, 1}, {1, 1}, {1, 0}, {-1, 1}, {0, -1}, {-1, -1}, {-1, 0}, {1, -1}};
+    for (int square = 0; square < 64; square++) {
+        int file = square % 8, rank = square / 8;
+        for (int i = 0; i < 8; i++) {
+            int f = file + knightSteps[i][0], r = rank + knightSteps[i][1];
+            if (f >= 0 && f < 8 && r >= 0 && r < 8) tables.knight[square] |= 1ULL << (r * 8 + f);
+            f = file + directions[i][0];
+            r = rank + directions[i][1];
+            if (f >= 0 && f < 8 && r >= 0 && r < 8) tables.king[square] |= 1ULL << (r * 8 + f);
+            while (f >= 0 && f < 8 && r >= 0 && r < 8) {
+                tables.rays[i][square] |= 1ULL << (r * 8 + f);
+                f += directions[i][0];
+                r += directions[i][1];
+            }
+        }
+    }
+    return tables;
+}
+
+constexpr AttackTables attackTables = makeAttackTables();
+
+
 class ChessBoard {
 public:
 
-    enum NodeType {
+    enum NodeType : uint8_t {
         EXACT,
         LOWERBOUND,
         UPPERBOUND
     };
+    // 16 bytes: the best move is kept as its moveCode, 0 for none
     struct TTEntry {
         uint64_t hashKey;
-        int depth;
-        int value;
+        int32_t value;
+        int8_t depth;
         NodeType flag;
-        Move bestMove;
+        uint16_t bestMove;
+    };
+
+    // Counters for one call to the search, reset at the start of generateBotMoves. They stay zero in
+    // builds with NO_SEARCH_STATS.
+    struct SearchStats {
+        long long nodes = 0;
+        long long qnodes = 0;
+        long long ttProbes = 0;
+        long long ttHits = 0;
+        long long ttCutoffs = 0;     // nodes answered by the TT bound without a search
+        long long betaCutoffs = 0;
+        long long firstMoveCutoffs = 0; // beta cutoffs by the first move searched, the ordering quality
+        long long nullMoveSearches = 0;
+        long long nullMoveCutoffs = 0;
+        long long lmrSearches = 0;
+        long long lmrResearches = 0; // reduced searches that beat alpha and had to be repeated at full depth
+        long long reverseFutilityPrunes = 0;
+        long long razorPrunes = 0;
+        long long futilityPrunes = 0;
+        long long lateMovePrunes = 0;
+        long long pawnHashProbes = 0;
+        long long pawnHashHits = 0;
+        long long fullEvals = 0;
+        long long lazyEvals = 0;     // evaluations that stopped after the cheap terms
+        long long evalCacheProbes = 0;
+        long long evalCacheHits = 0;
+        long long evalCalls = 0;
+        long long tablebaseHits = 0;
+        std::vector<double> iterationSeconds; // time of each iteration of the deepening, depth 1 first
+
+        static double percent(long long part, long long whole) {
+            return whole ? 100.0 * static_cast<double>(part) / static_cast<double>(whole) : 0.0;
+        }
+
+        void print(std::ostream &out = std::cout) const {
+            out << "nodes " << nodes << " qnodes " << qnodes << " evals " << evalCalls
+                << " | tt " << ttHits << "/" << ttProbes << " hits " << ttCutoffs << " cutoffs"
+                << " | first move cutoffs " << percent(firstMoveCutoffs, betaCutoffs) << "%"
+                << " | null move " << nullMoveCutoffs << "/" << nullMoveSearches
+                << " | lmr " << lmrSearches - lmrResearches << "/" << lmrSearches << std::endl;
+            out << "reverse futility " << reverseFutilityPrunes
+                << " razor " << razorPrunes
+                << " futility " << futilityPrunes
+                << " late move " << lateMovePrunes
+                << " | pawn hash " << pawnHashHits << "/" << pawnHashProbes
+                << " | lazy evals " << lazyEvals << "/" << (lazyEvals + fullEvals)
+                << " | eval cache " << evalCacheHits << "/" << evalCacheProbes
+                << " | tablebase " << tablebaseHits << std::endl;
+            out << "iterations (s):";
+            for (double seconds: iterationSeconds) out << " " << seconds;
+            out << std::endl;
+        }
+    };
+
+    // Pawn structure scores by pawn-only Zobrist key. Pawns move rarely compared to the other pieces,
+    // so nearly every evaluation finds its pawn structure here.
+    struct PawnHashTable {
+        static const size_t TABLE_SIZE = 1 << 14;
+        struct Entry {
+            uint64_t pawnKey;
+            int score;
+        };
+        std::vector<Entry> table;
+
+        PawnHashTable() : table(TABLE_SIZE) {}
+
+        void clear() {
+            std::fill(table.begin(), table.end(), Entry{0, 0});
+        }
+
+        Entry &entryFor(uint64_t pawnKey) {
+            return table[pawnKey & (TABLE_SIZE - 1)];
+        }
+    };
+
+    // Full static evaluations by position hash, direct mapped. Each board has its own, the entries are
+    // plain memory and not meant to be shared between threads.
+    struct EvalCache {
+        struct Entry {
+            uint64_t check;
+            uint64_t data;
+        };
+        std::vector<Entry> table;
+        size_t mask = 0;
+
+        explicit EvalCache(size_t entries = 1 << 16) { resize(entries); }
+
+        // Rounds down to a power of two, 0 turns the cache off
+        void resize(size_t entries) {
+            size_t size = 1;
+            while (size * 2 <= entries) size *= 2;
+            table.assign(entries ? size : 0, Entry{0, 0});
+            mask = entries ? size - 1 : 0;
+        }
+
+        void clear() {
+            std::fill(table.begin(), table.end(), Entry{0, 0});
+        }
+
+        bool probe(uint64_t key, int &score) const {
+            if (table.empty()) return false;
+            const Entry &entry = table[key & mask];
+            if ((entry.check ^ entry.data) != key) return false;
+            score = static_cast<int>(static_cast<int64_t>(entry.data));
+            return true;
+        }
+
+        void store(uint64_t key, int score) {
+            if (table.empty()) return;
+            uint64_t data = static_cast<uint64_t>(static_cast<int64_t>(score));
+            table[key & mask] = {key ^ data, data};
+        }
     };
 
     struct TranspositionTable {
-        static const size_t TABLE_SIZE = 1 << 20; // Example size, adjust as needed.
+        static const size_t TABLE_SIZE = 1 << 18; // 4 MB of 16 byte entries
         std::vector<TTEntry> table;
 
         TranspositionTable() : table(TABLE_SIZE) {}
 
-        void store(uint64_t hashKey, int depth, int value, NodeType flag, Move bestMove) {
+        void clear() {
+            std::fill(table.begin(), table.end(), TTEntry{});
+        }
+
+        void store(uint64_t hashKey, int depth, int value, NodeType flag, uint16_t bestMove) {
             size_t index = hashKey % TABLE_SIZE; // Simple modulo for index calculation.
             // You could add more sophisticated collision handling here.
-            table[index] = {hashKey, depth, value, flag, bestMove};
+            table[index] = {hashKey, value, static_cast<int8_t>(depth), flag, bestMove};
         }
 
         TTEntry *get(uint64_t hashKey) {
@@ -86,89 +270,62 @@ public:
     };
 
     int roundnr = 0;
+    SearchStats searchStats;
+
+    // Counters of the last search, still accumulating while one runs
+    const SearchStats &getSearchStats() const {
+        return searchStats;
+    }
     uint64_t zobristTable[64][12];
     uint64_t sideToMoveHash;
+    uint64_t hashKey = 0; // computeHash() for the side to move, kept up to date by movePiece/resetPreviousMove
+    EvalCache evalCache;
+    std::shared_ptr<const EvalParams> evalParams; // null while the defaults are used, shared by board copies
+    Nnue nnue;
+    bool useNnue = false; // evaluate with the network instead of shortEvalBoard's terms once one is loaded
+    std::shared_ptr<OpeningBook> openingBook; // null until loadBook
+    std::shared_ptr<const Tablebases> tablebases; // null until loadTablebases, shared by board copies
+    std::vector<uint64_t> hashHistory; // hashKey before each move in moveHistory (and each null move)
+    int halfmoveClock = 0;             // plies since the last capture or pawn move
+    uint64_t castlingHash[16];
+    uint64_t enPassantHash[8];
+    enum CastlingRight {
+        WhiteKingSide = 1, WhiteQueenSide = 2, BlackKingSide = 4, BlackQueenSide = 8
+    };
+    int castlingRights = WhiteKingSide | WhiteQueenSide | BlackKingSide | BlackQueenSide;
+    uint64_t enPassantSquare = 0; // Square a pawn skipped over with a double push last move, 0 if none
+    // Incremental eval sums, index 0 is white and 1 is black. Kept up to date by movePiece/resetPreviousMove
+    // so the leaf eval doesn't have to walk the board. positionalScore holds packed tapered scores.
+    int materialScore[2] = {};
+    int positionalScore[2] = {};
+    int pieceCount[2] = {};
+    TranspositionTable transpositionTable;
+    uint64_t pawnKey = 0; // Zobrist keys of the pawns only, for the pawn hash table
+    PawnHashTable pawnHashTable;
     vector<Move> rootMoves;
     Move BestMover;
     vector<Move> quiesceMoves;
     std::map<int, uint64_t> northMoves, southMoves, eastMoves, westMoves;
-    static const int pawnValue = 10;
-    static const int knightValue = 28;
-    static const int bishopValue = 28;
-    static const int rookValue = 40;
-    static const int queenValue = 70;
-    const int singleMoveOffsetWhite = 8;
-    const int singleMoveOffsetBlack = -8;
-    const int doubleMoveOffsetWhite = 16;
-    const int doubleMoveOffsetBlack = -16;
-    const int doubleMoveStartRowWhite = 1;
-    const int doubleMoveStartRowBlack = 6;
-    const std::vector<int> attackOffsetsWhite = {7, 9};
-    const std::vector<int> attackOffsetsBlack = {-9, -7};
-    const std::vector<int> knightOffsets{-17, -15, -10, -6, 6, 10, 15, 17};
-    const std::vector<int> pawnPositionalValue = {
-            0, 0, 0, 0, 0, 0, 0, 0,
-            3, 2, 1, -1, -1, -1, 1, 2,
-            2, 2, 4, 6, 6, 4, 2, 2,
-            1, 1, 2, 5, 5, 2, 1, 1,
-            0, 0, 1, 3, 3, 1, 0, 0,
-            0, 0, 0, 0, 0, 0, 0, 0,
-            5, 5, 5, 5, 5, 5, 5, 5,
-            0, 0, 0, 0, 0, 0, 0, 0,
-    };
-
-
-    // Positional values for knights
-    const std::vector<int> knightPositionalValue = {
-            -5, -2, -2, -2, -2, -2, -2, -5,
-            -2, 0, 0, 3, 3, 0, 0, -2,
-            -2, 0, 3, 6, 6, 3, 0, -2,
-            -2, 3, 6, 8, 8, 6, 3, -2,
-            -2, 3, 6, 8, 8, 6, 3, -2,
-            -2, 0, 3, 6, 6, 3, 0, -2,
-            -2, 0, 0, 3, 3, 0, 0, -2,
-            -5, -2, -2, -2, -2, -2, -2, -5,
-    };
-
-
-    const std::vector<int> bishopPositionalValue = {
-            -5, -2, -2, -2, -2, -2, -2, -5,
-            -2, 0, 0, 0, 0, 0, 0, -2,
-            -2, 0, 5, 5, 5, 5, 0, -2,
-            -2, 0, 5, 8, 8, 5, 0, -2,
-            -2, 0, 5, 8, 8, 5, 0, -2,
-            -2, 0, 5, 5, 5, 5, 0, -2,
-            -2, 0, 0, 0, 0, 0, 0, -2,
-            -5, -2, -2, -2, -2, -2, -5, -5,
-    };
-
-
-    const std::vector<int> rookPositionalValue = {
-            0, 0, 0, 5, 5, 0, 0, 0,
-            5, 10, 10, 5, 5, 10, 10, 5,
-            -5, 0, 0, 5, 5, 0, 0, -5,
-            -5, 0, 0, 5, 5, 0, 0, -5,
-            -5, 0, 0, 5, 5, 0, 0, -5,
-            -5, 0, 0, 5, 5, 0, 0, -5,
-            5, 10, 10, 10, 10, 10, 10, 5,
-            0, 0, 0, 5, 5, 0, 0, 0,
-    };
-
-
-    const std::vector<int> queenPositionalValue = {
-            -2, -2, -2, -2, -2, -2, -2, -2,
-            -2, 0, 0, 0, 0, 0, 0, -2,
-            -2, 0, 3, 3, 3, 3, 0, -2,
-            -2, 0, 3, 5, 5, 3, 0, -2,
-            -2, 0, 3, 5, 5, 3, 0, -2,
-            -2, 0, 3, 3, 3, 3, 0, -2,
-            -2, 0, 0, 0, 0, 0, 0, -2,
-            -2, -2, -2, -2, -2, -2, -2, -2,
-    };
+    static constexpr int pawnValue = defaultEvalParams.pawnValue;
+    static constexpr int knightValue = defaultEvalParams.knightValue;
+    static constexpr int bishopValue = defaultEvalParams.bishopValue;
+    static constexpr int rookValue = defaultEvalParams.rookValue;
+    static constexpr int queenValue = defaultEvalParams.queenValue;
+    static constexpr int singleMoveOffsetWhite = 8;
+    static constexpr int singleMoveOffsetBlack = -8;
+    static constexpr int doubleMoveOffsetWhite = 16;
+    static constexpr int doubleMoveOffsetBlack = -16;
+    static constexpr int doubleMoveStartRowWhite = 1;
+    static constexpr int doubleMoveStartRowBlack = 6;
+    static constexpr int attackOffsetsWhite[2] = {7, 9};
+    static constexpr int attackOffsetsBlack[2] = {-9, -7};
+    static constexpr int knightOffsets[8] = {-17, -15, -10, -6, 6, 10, 15, 17};
+    // The phase runs from 24 with all pieces on the board down to 0 with only kings and pawns
+    static const int maxGamePhase = 24;
 
 
     // Additional score for capturing a more valuable piece with a less valuable piece
-    const int captureBonus = 2;
+    static constexpr int captureBonus = 2;
     uint64_t whitePawns{};
     uint64_t whiteRooks{};
     uint64_t whiteKnights{};
@@ -190,14 +347,19 @@ public:
     uint64_t previousMoveFrom{};
     uint64_t previousMoveTo{};
     bool whitesTurn = true;
+    // The side to move in the position on the board, flipped with hashKey by movePiece and makeNullMove.
+    // whitesTurn is the game's turn, which the search leaves alone.
+    bool whiteToMove = true;
 
     enum PieceType {
         Pawn, Knight, Bishop, Rook, Queen, King, None
     };
 
     ChessBoard() {
+        initZobrist();
         resetBoard();
         precomputeMoves();
+        initLmrTable();
 
     }
     // Part of your ChessBoard or equivalent class
@@ -266,6 +428,220 @@ public:
         return possibleMoves;
     }
 
+    // Fixed seed so hashes (and with them the search) are the same on every run
+    void initZobrist() {
+        std::mt19937_64 random(0x5EED2024ULL);
+        for (auto &square: zobristTable) {
+            for (uint64_t &key: square) {
+                key = random();
+            }
+        }
+        sideToMoveHash = random();
+        for (uint64_t &key: castlingHash) {
+            key = random();
+        }
+        for (uint64_t &key: enPassantHash) {
+            key = random();
+        }
+    }
+
+    // Zobrist piece index (pieceType + 6 for black) for one of the piece bitboards
+    int zobristIndexFor(const uint64_t *bitboard) const {
+        const uint64_t *bitboards[12] = {&whitePawns, &whiteKnights, &whiteBishops, &whiteRooks, &whiteQueens,
+                                         &whiteKing, &blackPawns, &blackKnights, &blackBishops, &blackRooks,
+                                         &blackQueens, &blackKing};
+        for (int i = 0; i < 12; ++i) {
+            if (bitboards[i] == bitboard) return i;
+        }
+        return -1;
+    }
+
+    // A piece of this bitboard appears (sign 1) on or disappears (sign -1) from square: XOR its key in or
+    // out of hashKey and add or subtract it from the eval sums. resetPreviousMove takes the hash back from
+    // hashHistory, so it only needs the scores.
+    void updatePieceState(const uint64_t *bitboard, uint64_t square, int sign, bool updateHash = true) {
+        int pieceIndex = zobristIndexFor(bitboard);
+        int position = bitScanForward(square);
+        if (updateHash) {
+            hashKey ^= zobristTable[position][pieceIndex];
+        }
+        if (pieceIndex == 0 || pieceIndex == 6) {
+            pawnKey ^= zobristTable[position][pieceIndex]; // XORed back on unmake as well
+        }
+        auto pieceType = static_cast<PieceType>(pieceIndex % 6);
+        if (evalParams) {
+            updatePieceScores<true>(pieceType, position, pieceIndex < 6, sign);
+        } else {
+            updatePieceScores<false>(pieceType, position, pieceIndex < 6, sign);
+        }
+        if (nnue.loaded()) {
+            nnue.update(pieceIndex, position, sign);
+        }
+    }
+
+    // The default weights are looked up as constants, like in shortEvalBoardWith
+    template<bool CustomParams>
+    void updatePieceScores(PieceType pieceType, int position, bool white, int sign) {
+        const EvalParams &params = CustomParams ? *evalParams : defaultEvalParams;
+        int side = white ? 0 : 1;
+        materialScore[side] += sign * params.pieceValue(pieceType);
+        positionalScore[side] += sign * params.positionalValue(pieceType, position, white);
+        pieceCount[side] += sign;
+    }
+
+    // Rebuilds the incremental eval sums from the bitboards, after setting up a new position
+    void computeIncrementalScores() {
+        for (int side = 0; side < 2; ++side) {
+            materialScore[side] = positionalScore[side] = pieceCount[side] = 0;
+        }
+        pawnKey = 0;
+        const EvalParams &params = activeEvalParams();
+        for (int square = 0; square < 64; ++square) {
+            PieceType pieceType = getPieceTypeOnSquare(square);
+            if (pieceType == None) continue;
+            bool white = isSquareOccupiedByWhite(square);
+            int side = white ? 0 : 1;
+            materialScore[side] += params.pieceValue(pieceType);
+            positionalScore[side] += params.positionalValue(pieceType, square, white);
+            pieceCount[side]++;
+            if (pieceType == Pawn) {
+                pawnKey ^= zobristTable[square][white ? 0 : 6];
+            }
+        }
+        nnue.markDirty();
+    }
+
+    const EvalParams &activeEvalParams() const {
+        return evalParams ? *evalParams : defaultEvalParams;
+    }
+
+    // Evaluates with params from now on. The incremental sums are rebuilt and the pawn hash and eval
+    // cache emptied, they hold scores from the old weights.
+    void useEvalParams(const EvalParams &params) {
+        evalParams = std::make_shared<const EvalParams>(params);
+        pawnHashTable.clear();
+        evalCache.clear();
+        computeIncrementalScores();
+    }
+
+    // Forgets everything earlier searches left behind, so the next search runs as on a fresh board
+    void clearHashTables() {
+        transpositionTable.clear();
+        pawnHashTable.clear();
+        evalCache.clear();
+        clearMoveOrdering();
+    }
+
+    // Killers and history belong to one search, searchBestMove starts without them
+    void clearMoveOrdering() {
+        std::memset(killerMoves, 0, sizeof(killerMoves));
+        std::memset(historyScores, 0, sizeof(historyScores));
+    }
+
+    // Weights from a parameter file (format in EvalParams.h) on top of the current ones
+    bool loadEvalParams(const std::string &path) {
+        EvalParams params = activeEvalParams();
+        if (!params.load(path)) return false;
+        useEvalParams(params);
+        return true;
+    }
+
+    // One override such as "knightValue=30" or "doubledPawnPenalty=-3,-5"
+    bool setEvalParam(const std::string &assignment) {
+        EvalParams params = activeEvalParams();
+        if (!params.set(assignment)) return false;
+        useEvalParams(params);
+        return true;
+    }
+
+    // Loads network weights (see Nnue.h) and switches the evaluation over to them
+    bool loadNnue(const std::string &path) {
+        if (!nnue.load(path)) {
+            std::cerr << "Could not load network weights from " << path << std::endl;
+            return false;
+        }
+        useNnue = true;
+        return true;
+    }
+
+    // The network scores the side to move, white picks the side the score is returned for
+    int nnueEvaluation(bool white) {
+        const uint64_t *const bitboards[12] = {&whitePawns, &whiteKnights, &whiteBishops, &whiteRooks, &whiteQueens,
+                                               &whiteKing, &blackPawns, &blackKnights, &blackBishops, &blackRooks,
+                                               &blackQueens, &blackKing};
+        int score = nnue.evaluate(whiteToMove ? 0 : 1, bitboards);
+        return whiteToMove == white ? score : -score;
+    }
+
+    // Opens a Polyglot book for generateBotMoves to play from, keyed with the standard Random64 table
+    bool loadBook(const std::string &path) {
+        auto book = std::make_shared<OpeningBook>();
+        if (!book->book.open(path)) {
+            std::cerr << "Could not open opening book " << path << std::endl;
+            return false;
+        }
+        openingBook = std::move(book);
+        return true;
+    }
+
+    uint64_t polyglotKey(bool isWhitesTurn) const {
+        const uint64_t *const bitboards[12] = {&whitePawns, &whiteKnights, &whiteBishops, &whiteRooks, &whiteQueens,
+                                               &whiteKing, &blackPawns, &blackKnights, &blackBishops, &blackRooks,
+                                               &blackQueens, &blackKing};
+        // Polyglot only counts the en passant square when a pawn can actually take there
+        uint64_t takers = isWhitesTurn ? whitePawnAttacks(whitePawns) : blackPawnAttacks(blackPawns);
+        int enPassantFile = (enPassantSquare & takers) ? bitScanForward(enPassantSquare) % 8 : -1;
+        return PolyglotKeys::key(bitboards, castlingRights, enPassantFile, isWhitesTurn);
+    }
+
+    // A weighted random book move for the side to move, false when the book has none for this position
+    bool bookMove(bool white, Move &move) {
+        PolyglotBook::Entry entry{};
+        if (!openingBook || !openingBook->book.pick(polyglotKey(white), openingBook->random, entry)) return false;
+        std::string text = PolyglotBook::moveText(entry.move);
+        uint64_t from = 1ULL << ((text[1] - '1') * 8 + (text[0] - 'a'));
+        if (from & (white ? whiteKing : blackKing)) {
+            if (text == "e1h1" || text == "e8h8") text[2] = 'g';
+            if (text == "e1a1" || text == "e8a8") text[2] = 'c';
+        }
+        return parseMove(text, white, move);
+    }
+
+    // Opens the endgame tables in directory (see Tablebase.h), the search probes them from then on
+    bool loadTablebases(const std::string &directory) {
+        auto tables = std::make_shared<Tablebases>();
+        int loaded = tables->load(directory);
+        if (loaded == 0) {
+            std::cerr << "No endgame tables in " << directory << std::endl;
+            return false;
+        }
+        std::cout << loaded << " endgame tables, up to " << tables->maxPieces() << " pieces" << std::endl;
+        tablebases = std::move(tables);
+        return true;
+    }
+
+    // The exact score for the side to move from the endgame tables, false when the position isn't in them.
+    // The tables know nothing of castling and en passant, positions where either is possible get searched.
+    bool probeTablebase(bool white, int ply, int &score) const {
+        if (!tablebases || castlingRights != 0 || __builtin_popcountll(occupiedSquares) > tablebases->maxPieces()) {
+            return false;
+        }
+        uint64_t takers = white ? whitePawnAttacks(whitePawns) : blackPawnAttacks(blackPawns);
+        if (enPassantSquare & takers) return false;
+        const uint64_t *const bitboards[12] = {&whitePawns, &whiteKnights, &whiteBishops, &whiteRooks, &whiteQueens,
+                                               &whiteKing, &blackPawns, &blackKnights, &blackBishops, &blackRooks,
+                                               &blackQueens, &blackKing};
+        uint8_t value;
+        if (!tablebases->probe(bitboards, white, value)) return false;
+        if (value == Tablebases::DRAW) {
+            score = drawScore;
+        } else {
+            int plies = Tablebases::plies(value);
+            score = Tablebases::isWin(value) ? MATE_SCORE - ply - plies : -MATE_SCORE + ply + plies;
+        }
+        return true;
+    }
+
     uint64_t computeHash(bool isWhitesTurn) const {
         uint64_t hash = 0;
 
@@ -285,7 +661,10 @@ public:
             hash ^= sideToMoveHash;
         }
 
-        // Add other states like castling rights, en passant square, etc., to the hash as needed
+        hash ^= castlingHash[castlingRights];
+        if (enPassantSquare) {
+            hash ^= enPassantHash[bitScanForward(enPassantSquare) % 8];
+        }
 
         return hash;
     }
@@ -332,10 +711,65 @@ public:
         blackQueens = 0x800000000000000ULL;
         blackKing = 0x1000000000000000ULL;
         updateOccupiedSquares();
+        moveHistory.clear();
+        hashHistory.clear();
+        halfmoveClock = 0;
+        castlingRights = WhiteKingSide | WhiteQueenSide | BlackKingSide | BlackQueenSide;
+        enPassantSquare = 0;
+        whitesTurn = whiteToMove = true;
+        hashKey = computeHash(true);
+        computeIncrementalScores();
         //printBoard();
 
     }
 
+    // Set up a position from FEN, returns false (leaving the board in an undefined state) on a malformed string
+    bool loadFen(const std::string &fen) {
+        std::istringstream stream(fen);
+        std::string placement, side, castling = "-", enPassant = "-";
+        int halfmoves = 0;
+        if (!(stream >> placement >> side)) return false;
+        stream >> castling >> enPassant >> halfmoves;
+
+        uint64_t *bitboards[12] = {&whitePawns, &whiteKnights, &whiteBishops, &whiteRooks, &whiteQueens, &whiteKing,
+                                   &blackPawns, &blackKnights, &blackBishops, &blackRooks, &blackQueens, &blackKing};
+        for (uint64_t *bitboard: bitboards) *bitboard = 0;
+        const std::string pieceLetters = "PNBRQKpnbrqk";
+        int rank = 7, file = 0;
+        for (char c: placement) {
+            if (c == '/') {
+                rank--;
+                file = 0;
+            } else if (c >= '1' && c <= '8') {
+                file += c - '0';
+            } else {
+                size_t piece = pieceLetters.find(c);
+                if (piece == std::string::npos || rank < 0 || file > 7) return false;
+                *bitboards[piece] |= 1ULL << (rank * 8 + file);
+                file++;
+            }
+        }
+        whitesTurn = whiteToMove = side != "b";
+        castlingRights = 0;
+        for (char c: castling) {
+            if (c == 'K') castlingRights |= WhiteKingSide;
+            if (c == 'Q') castlingRights |= WhiteQueenSide;
+            if (c == 'k') castlingRights |= BlackKingSide;
+            if (c == 'q') castlingRights |= BlackQueenSide;
+        }
+        enPassantSquare = 0;
+        if (enPassant.size() == 2) {
+            enPassantSquare = 1ULL << ((enPassant[1] - '1') * 8 + (enPassant[0] - 'a'));
+        }
+        halfmoveClock = halfmoves;
+        updateOccupiedSquares();
+        moveHistory.clear();
+        hashHistory.clear();
+        hashKey = computeHash(whitesTurn);
+        computeIncrementalScores();
+        return true;
+    }
+
     //update the occupied squares
     void updateOccupiedSquares() {
         occupiedSquares = whitePawns | whiteRooks | whiteKnights | whiteBishops | whiteQueens | whiteKing
@@ -350,27 +784,49 @@ public:
     // This is a simplistic example. A real move function would need to be much more comprehensive.
     void movePiece(uint64_t &pieceBitboard, uint64_t fromSquare, uint64_t toSquare,
                    uint64_t *capturedPieceBitboard = nullptr) {
-        // Log the move before making it
         bool capture = capturedPieceBitboard && (*capturedPieceBitboard & toSquare);
-        moveHistory.emplace_back(&pieceBitboard, fromSquare, toSquare, capturedPieceBitboard, capture, false);
-
-        // Make the move
-        pieceBitboard &= ~fromSquare;
-        pieceBitboard |= toSquare;
+        movePiece(Move(&pieceBitboard, fromSquare, toSquare, capturedPieceBitboard, capture, false));
+    }
 
-        // If there's a capture, remove the captured piece
-        if (capture) {
-            *capturedPieceBitboard &= ~toSquare;
-        }
+    // Rights that are gone once anything moves from or to one of these squares
+    int castlingRightsAfter(int rights, uint64_t squares) const {
+        if (squares & 0x10ULL) rights &= ~(WhiteKingSide | WhiteQueenSide);
+        if (squares & 0x80ULL) rights &= ~WhiteKingSide;
+        if (squares & 0x1ULL) rights &= ~WhiteQueenSide;
+        if (squares & 0x1000000000000000ULL) rights &= ~(BlackKingSide | BlackQueenSide);
+        if (squares & 0x8000000000000000ULL) rights &= ~BlackKingSide;
+        if (squares & 0x100000000000000ULL) rights &= ~BlackQueenSide;
+        return rights;
+    }
 
-        updateOccupiedSquares();
-        //Board();
+    // Square the captured piece stands on, behind the destination for en passant
+    static uint64_t capturedSquareOf(const Move &move) {
+        if (!move.enPassant) return move.toSquare;
+        return move.toSquare > move.fromSquare ? move.toSquare >> 8 : move.toSquare << 8;
     }
 
     void movePiece(Move move) {
-
+        PROFILE_SCOPE(Make);
+        move.previousHalfmoveClock = halfmoveClock;
+        move.previousCastlingRights = castlingRights;
+        move.previousEnPassantSquare = enPassantSquare;
         moveHistory.push_back(move);
+        hashHistory.push_back(hashKey);
+        bool pawnMove = move.pieceMoved == &whitePawns || move.pieceMoved == &blackPawns;
+        halfmoveClock = (move.capture || pawnMove) ? 0 : halfmoveClock + 1;
+        hashKey ^= sideToMoveHash;
+        whiteToMove = !whiteToMove;
+        hashKey ^= castlingHash[castlingRights];
+        if (enPassantSquare) {
+            hashKey ^= enPassantHash[bitScanForward(enPassantSquare) % 8];
+            enPassantSquare = 0;
+        }
         if (move.castle) {
+            uint64_t *kingBitboard = move.whiteKing ? &whiteKing : &blackKing;
+            updatePieceState(move.pieceMoved, move.fromSquare, -1);
+            updatePieceState(move.pieceMoved, move.toSquare, 1);
+            updatePieceState(kingBitboard, move.kingFromSquare, -1);
+            updatePieceState(kingBitboard, move.kingToSquare, 1);
             *move.pieceMoved &= ~move.fromSquare;
             *move.pieceMoved |= move.toSquare;
             if (move.whiteKing) {
@@ -380,57 +836,59 @@ public:
                 blackKing &= ~move.kingFromSquare;
                 blackKing |= move.kingToSquare;
             }
-        }/*
-        else if (move.promotion){
-            *move.pieceMoved &= ~move.fromSquare;
-            // Add a queen to the destination square
-            uint64_t* queenBitboard = whitePawns ? &whiteQueens : &blackQueens;
-            *queenBitboard |= move.toSquare;
-        }*/else {
-
+            castlingRights = castlingRightsAfter(castlingRights, move.kingFromSquare);
+        } else {
             if (move.capture) {
-                int score = getPieceValue(getPieceTypeOnSquare(bitScanForward(move.toSquare)));
-                move.score += score;
-                *move.pieceCaptured &= ~move.toSquare;
+                uint64_t capturedSquare = capturedSquareOf(move);
+                updatePieceState(move.pieceCaptured, capturedSquare, -1);
+                *move.pieceCaptured &= ~capturedSquare;
             }
+            // A promoting pawn leaves its own bitboard and lands on the promotion piece's
+            uint64_t *landingBitboard = move.promotion ? move.promotedTo : move.pieceMoved;
+            updatePieceState(move.pieceMoved, move.fromSquare, -1);
+            updatePieceState(landingBitboard, move.toSquare, 1);
             *move.pieceMoved &= ~move.fromSquare;
-            *move.pieceMoved |= move.toSquare;
+            *landingBitboard |= move.toSquare;
 
-            /*
-            if (move.capture) {
-                if (isSquareThreatened(bitScanForward(move.toSquare), !isSquareOccupiedByWhite((move.toSquare)))) {
-                    int score = getPieceValue(getPieceTypeOnSquare(bitScanForward(move.toSquare)));
-                    int score2 = getPieceValue(getPieceTypeOnSquare(bitScanForward(move.fromSquare)));
-                    if (score2 > score) {
-                        move.score -= 10000;
-                    }else{
-                        move.score += score;
-                    }
-                }else{
-                    move.score += getPieceValue(getPieceTypeOnSquare(bitScanForward(move.toSquare)));
-                }
-                *move.pieceCaptured &= ~move.toSquare;
+            if (pawnMove && (move.toSquare == move.fromSquare << 16 || move.toSquare == move.fromSquare >> 16)) {
+                enPassantSquare = move.toSquare > move.fromSquare ? move.fromSquare << 8 : move.fromSquare >> 8;
+                hashKey ^= enPassantHash[bitScanForward(enPassantSquare) % 8];
             }
-            *move.pieceMoved &= ~move.fromSquare;
-            *move.pieceMoved |= move.toSquare;
-             */
+            castlingRights = castlingRightsAfter(castlingRights, move.fromSquare | move.toSquare);
         }
-
+        hashKey ^= castlingHash[castlingRights];
 
         updateOccupiedSquares();
     }
 
     //reset the previous move
     void resetPreviousMove() {
+        PROFILE_SCOPE(Unmake);
         if (!moveHistory.empty()) {
             Move lastMove = moveHistory.back(); // Capture the last move for readability
+            hashKey = hashHistory.back();
+            hashHistory.pop_back();
+            whiteToMove = !whiteToMove;
+            halfmoveClock = lastMove.previousHalfmoveClock;
+            castlingRights = lastMove.previousCastlingRights;
+            enPassantSquare = lastMove.previousEnPassantSquare;
             if (!lastMove.castle) {
+                uint64_t *landingBitboard = lastMove.promotion ? lastMove.promotedTo : lastMove.pieceMoved;
+                *landingBitboard &= ~lastMove.toSquare; // Clear the piece's new square
                 *lastMove.pieceMoved |= lastMove.fromSquare; // Restore the piece to its original square
-                *lastMove.pieceMoved &= ~lastMove.toSquare; // Clear the piece's new square
+                updatePieceState(landingBitboard, lastMove.toSquare, -1, false);
+                updatePieceState(lastMove.pieceMoved, lastMove.fromSquare, 1, false);
                 if (lastMove.capture) {
-                    *lastMove.pieceCaptured |= lastMove.toSquare; // Restore the captured piece
+                    uint64_t capturedSquare = capturedSquareOf(lastMove);
+                    *lastMove.pieceCaptured |= capturedSquare; // Restore the captured piece
+                    updatePieceState(lastMove.pieceCaptured, capturedSquare, 1, false);
                 }
             } else {
+                uint64_t *kingBitboard = lastMove.whiteKing ? &whiteKing : &blackKing;
+                updatePieceState(lastMove.pieceMoved, lastMove.toSquare, -1, false);
+                updatePieceState(lastMove.pieceMoved, lastMove.fromSquare, 1, false);
+                updatePieceState(kingBitboard, lastMove.kingToSquare, -1, false);
+                updatePieceState(kingBitboard, lastMove.kingFromSquare, 1, false);
                 *lastMove.pieceMoved |= lastMove.fromSquare;
                 *lastMove.pieceMoved &= ~lastMove.toSquare;
                 if (lastMove.whiteKing) {
@@ -448,6 +906,56 @@ public:
         }
     }
 
+    // What a null move changes besides the side to move, handed back to unmakeNullMove
+    struct NullMoveUndo {
+        int halfmoveClock;
+        uint64_t enPassantSquare;
+    };
+
+    // Passing the turn, only used by null move pruning. The halfmove clock is zeroed
+    // because no repetition can reach back across a null move
+    NullMoveUndo makeNullMove() {
+        NullMoveUndo undo{halfmoveClock, enPassantSquare};
+        hashHistory.push_back(hashKey);
+        halfmoveClock = 0;
+        hashKey ^= sideToMoveHash;
+        whiteToMove = !whiteToMove;
+        if (enPassantSquare) {
+            hashKey ^= enPassantHash[bitScanForward(enPassantSquare) % 8];
+            enPassantSquare = 0;
+        }
+        return undo;
+    }
+
+    void unmakeNullMove(const NullMoveUndo &undo) {
+        hashKey = hashHistory.back();
+        hashHistory.pop_back();
+        whiteToMove = !whiteToMove;
+        halfmoveClock = undo.halfmoveClock;
+        enPassantSquare = undo.enPassantSquare;
+    }
+
+    // True if the current position occurred before. Only the last halfmoveClock plies can repeat, and only
+    // every second one has the same side to move. A repeat inside the search tree (less than ply plies back)
+    // counts as a draw straight away, older history needs the position twice for a real threefold.
+    bool isRepetition(int ply) const {
+        int size = static_cast<int>(hashHistory.size());
+        int reversiblePlies = std::min(halfmoveClock, size);
+        int repetitions = 0;
+        for (int pliesBack = 4; pliesBack <= reversiblePlies; pliesBack += 2) {
+            if (hashHistory[size - pliesBack] == hashKey) {
+                if (pliesBack <= ply || ++repetitions == 2) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool isDrawByRule(int ply) const {
+        return halfmoveClock >= 100 || isRepetition(ply);
+    }
+
 
 
     void printBoard() const {
@@ -584,6 +1092,21 @@ public:
     }
 
 
+    // Adds a pawn move, or all four promotions (queen first) when it reaches the last rank
+    void addPawnMove(std::vector<Move> &moves, uint64_t *pawnBitboard, int startSquare, int targetSquare,
+                     uint64_t *capturedPieceBitboard, bool isCapture, bool isWhite) {
+        if (!isPromotionSquare(targetSquare, isWhite)) {
+            moves.emplace_back(pawnBitboard, 1ULL << startSquare, 1ULL << targetSquare, capturedPieceBitboard,
+                               isCapture, false);
+            return;
+        }
+        for (PieceType promotion: {Queen, Knight, Rook, Bishop}) {
+            Move move(pawnBitboard, 1ULL << startSquare, 1ULL << targetSquare, capturedPieceBitboard, isCapture, true);
+            move.promotedTo = getBitboardPointerByPieceType(promotion, isWhite);
+            moves.push_back(move);
+        }
+    }
+
     std::vector<Move> generatePawnMoves(uint64_t pawnPosition) {
         std::vector<Move> moves;
         int startSquare = bitScanForward(pawnPosition);
@@ -603,7 +1126,7 @@ public:
         // Single forward move
         int targetSquare = startSquare + singleMoveOffset;
         if (targetSquare >= 0 && targetSquare < 64 && !(occupiedSquares & (1ULL << targetSquare))) {
-            moves.emplace_back(pawnBitboard, 1ULL << startSquare, 1ULL << targetSquare, nullptr, false, false);
+            addPawnMove(moves, pawnBitboard, startSquare, targetSquare, nullptr, false, isWhite);
 
             if (startSquare / 8 == doubleMoveStartRow &&
                 !(occupiedSquares & (1ULL << (startSquare + doubleMoveOffset)))) {
@@ -618,12 +1141,18 @@ public:
             // Check valid square range, prevent wrap-around, and ensure there is an enemy piece to capture
             if (targetSquare >= 0 && targetSquare < 64 &&
                 ((startSquare % 8 != 0) || (offset != -9 && offset != 7)) && // Not wrapping left for left attacks
-                ((startSquare % 8 != 7) || (offset != -7 && offset != 9)) && // Not wrapping right for right attacks
-                (enemyPieces & (1ULL << targetSquare))) {
-                // Capture move
-                moves.emplace_back(pawnBitboard, 1ULL << startSquare, 1ULL << targetSquare,
-                                   getBitboardPointerByPieceType(getPieceTypeOnSquare(targetSquare), !isWhite), true,
-                                   false);
+                ((startSquare % 8 != 7) || (offset != -7 && offset != 9))) { // Not wrapping right for right attacks
+                if (enemyPieces & (1ULL << targetSquare)) {
+                    // Capture move
+                    addPawnMove(moves, pawnBitboard, startSquare, targetSquare,
+                                getBitboardPointerByPieceType(getPieceTypeOnSquare(targetSquare), !isWhite), true,
+                                isWhite);
+                } else if (enPassantSquare == (1ULL << targetSquare)) {
+                    Move move(pawnBitboard, 1ULL << startSquare, 1ULL << targetSquare, isWhite ? &blackPawns : &whitePawns,
+                              true, false);
+                    move.enPassant = true;
+                    moves.push_back(move);
+                }
             }
         }
 
@@ -713,46 +1242,6 @@ public:
             }
         }
          */
-// Move(uint64_t* moved, uint64_t from, uint64_t to, bool cas, uint64_t kingTo, uint64_t kingFrom, bool whiteking)
-        //add castling as a move
-        //if theres no pieces between the king and the rook
-        if (isWhite) {
-            //first check white rook at position 0, and if king is at position 4
-            if (rookPosition == 0x1ULL && whiteKing == 0x10ULL) {
-                //check if there are no pieces between the king and the rook
-                if ((occupiedSquares & 0x60ULL) == 0) {
-                    moves.emplace_back(&whiteRooks, 0x1ULL, 0x20ULL, true, 0x40ULL, 0x10ULL, true);
-                }
-
-            }
-            //check if white rook is at position 7, and if king is at position 4
-            if (rookPosition == 0x80ULL && whiteKing == 0x10ULL) {
-                //check if there are no pieces between the king and the rook
-                if ((occupiedSquares & 0x60ULL) == 0) {
-                    moves.emplace_back(&whiteRooks, 0x80ULL, 0x10ULL, true, 0x40ULL, 0x10ULL, true);
-                }
-            }
-        } else {
-            if (rookPosition == 0x100000000000000ULL && blackKing == 0x1000000000000ULL) {
-                //check if there are no pieces between the king and the rook
-                if ((occupiedSquares & 0x7000000000000000ULL) == 0) {
-                    moves.emplace_back(&blackRooks, 0x100000000000000ULL, 0x1000000000000ULL, true,
-                                       0x4000000000000000ULL, 0x1000000000000ULL, false);
-                }
-            }
-            //check if white rook is at position 7, and if king is at position 4
-            if (rookPosition == 0x8000000000000000ULL && blackKing == 0x1000000000000ULL) {
-                //check if there are no pieces between the king and the rook
-                if ((occupiedSquares & 0xE000000000000000ULL) == 0) {
-                    moves.emplace_back(&blackRooks, 0x8000000000000000ULL, 0x1000000000000ULL, true,
-                                       0x2000000000000000ULL, 0x1000000000000ULL, false);
-                }
-            }
-
-
-        }
-
-
         return moves;
     }
 /*
@@ -937,8 +1426,9 @@ public:
         for (int offset: offsets) {
             int targetSquare = startSquare + offset;
 
-            // Continue if the target square is not on the board
+            // Continue if the target square is not on the board, or the move wraps around an edge
             if (!isSquareInBounds(startSquare, targetSquare)) continue;
+            if (abs(startSquare % 8 - targetSquare % 8) > 1) continue;
 
             uint64_t targetBitboard = 1ULL << targetSquare;
             // Skip if the target square is occupied by own piece
@@ -953,9 +1443,34 @@ public:
             moves.emplace_back(kingBitboard, 1ULL << startSquare, 1ULL << targetSquare, capturedPieceBitboard,
                                isCapture, false);
         }
+        addCastlingMoves(moves, isWhite);
         return moves;
     }
 
+    // Castling is stored as a rook move with the king's squares alongside. It needs the right, the rook
+    // still at home, nothing in between, and the king not in check nor passing or landing on an attacked square.
+    void addCastlingMoves(std::vector<Move> &moves, bool isWhite) {
+        int shift = isWhite ? 0 : 56;
+        int kingSide = isWhite ? WhiteKingSide : BlackKingSide;
+        int queenSide = isWhite ? WhiteQueenSide : BlackQueenSide;
+        uint64_t king = isWhite ? whiteKing : blackKing;
+        uint64_t rooks = isWhite ? whiteRooks : blackRooks;
+        uint64_t *rookBitboard = isWhite ? &whiteRooks : &blackRooks;
+        if (!(castlingRights & (kingSide | queenSide)) || king != (0x10ULL << shift)) return;
+        if (isSquareThreatened(4 + shift, isWhite)) return;
+
+        if ((castlingRights & kingSide) && (rooks & (0x80ULL << shift)) && !(occupiedSquares & (0x60ULL << shift)) &&
+            !isSquareThreatened(5 + shift, isWhite) && !isSquareThreatened(6 + shift, isWhite)) {
+            moves.emplace_back(rookBitboard, 0x80ULL << shift, 0x20ULL << shift, true, 0x40ULL << shift,
+                               0x10ULL << shift, isWhite);
+        }
+        if ((castlingRights & queenSide) && (rooks & (0x1ULL << shift)) && !(occupiedSquares & (0xEULL << shift)) &&
+            !isSquareThreatened(3 + shift, isWhite) && !isSquareThreatened(2 + shift, isWhite)) {
+            moves.emplace_back(rookBitboard, 0x1ULL << shift, 0x8ULL << shift, true, 0x4ULL << shift,
+                               0x10ULL << shift, isWhite);
+        }
+    }
+
 
     bool playerMove(int startRank, int startFile, int targetRank, int targetFile) {
         int i = 0;
@@ -977,7 +1492,7 @@ public:
             std::vector<Move> movesThatResolveCheck = filterMovesThatResolveCheck(possibleMoves, whitesTurn);
             // Check if the move is valid
             for (const Move &move: movesThatResolveCheck) {
-                if (move.toSquare == toMask) {
+                if ((move.castle ? move.kingToSquare : move.toSquare) == toMask) {
                     movePiece(move);
                     whitesTurn = !whitesTurn;
                     generateBotMoves();
@@ -1000,7 +1515,7 @@ public:
                 resetPreviousMove(); // Undo the move
 
                 // Only proceed if our king isn't in check as a result of this move
-                if (!ourKingInCheckAfterMove && move.toSquare == toMask) {
+                if (!ourKingInCheckAfterMove && (move.castle ? move.kingToSquare : move.toSquare) == toMask) {
                     // The move is valid and does not place our king in check
                     movePiece(move);
                     whitesTurn = !whitesTurn;
@@ -1016,6 +1531,7 @@ public:
     }
 
     bool isKingInCheck(bool isWhite) {
+        PROFILE_SCOPE(Legality);
         // Determine positions and enemy color
         if (isSquareThreatened(bitScanForward(isWhite ? (whiteKing) : (blackKing)), isWhite)) {
             return true;
@@ -1148,6 +1664,7 @@ public:
     }
 
     std::vector<Move> generateMovesForColor(bool white) {
+        PROFILE_SCOPE(Generate);
         std::vector<Move> allPossibleMoves;
         for (int i = 0; i < 64; i++) {
             uint64_t position = 1ULL << i;
@@ -1156,14 +1673,8 @@ public:
                     for (auto &move: generateMovesForPiece(position, getPieceTypeOnSquare((i)))) {
                         movePiece(move);
                         if (!isKingInCheck(true)) {
+                            move.score = moveOrderScore(move, true);
                             allPossibleMoves.push_back(move);
-                            if (move.capture) {
-                                if (isSquareThreatened(bitScanForward(move.toSquare), false)) {
-                                    move.score -= 100;
-                                } else {
-                                    move.score += 100;
-                                }
-                            }
                         }
                         resetPreviousMove();
                     }
@@ -1173,27 +1684,40 @@ public:
                     for (auto &move: generateMovesForPiece(position, getPieceTypeOnSquare((i)))) {
                         movePiece(move);
                         if (!isKingInCheck(false)) {
+                            move.score = moveOrderScore(move, false);
                             allPossibleMoves.push_back(move);
-                            if (move.capture) {
-                                if (isSquareThreatened(bitScanForward(move.toSquare), true)) {
-                                    move.score -= 100;
-                                } else {
-                                    move.score += 100;
-                                }
-                            }
                         }
                         resetPreviousMove();
                     }
                 }
             }
         }
-        std::sort(allPossibleMoves.begin(), allPossibleMoves.end(), [](const Move &a, const Move &b) {
+        std::stable_sort(allPossibleMoves.begin(), allPossibleMoves.end(), [](const Move &a, const Move &b) {
             return a.score > b.score;
         });
-        //remove last 50% of moves
         return allPossibleMoves;
     }
 
+    // Where a legal move goes in the ordering, called with the move made. Captures are ranked MVV-LVA: the
+    // most valuable victim first and the cheapest attacker first among equal victims. A capture of a
+    // cheaper piece on a square the opponent covers goes behind the quiet moves. Queen promotions come
+    // right after the winning captures, underpromotions keep their place. The search scores the quiet
+    // moves (orderQuietMoves).
+    int moveOrderScore(const Move &move, bool white) {
+        int score = 0;
+        if (move.promotion && move.promotedTo == (white ? &whiteQueens : &blackQueens)) {
+            score += QUEEN_PROMOTION_ORDER;
+        }
+        if (move.capture) {
+            int victim = zobristIndexFor(move.pieceCaptured) % 6;
+            int attacker = zobristIndexFor(move.pieceMoved) % 6;
+            bool losing = defaultEvalParams.pieceValue(victim) < defaultEvalParams.pieceValue(attacker) &&
+                          isSquareThreatened(bitScanForward(move.toSquare), white);
+            score += (losing ? LOSING_CAPTURE_ORDER : CAPTURE_ORDER) + 8 * victim - attacker;
+        }
+        return score;
+    }
+
 
     std::vector<Move> generateMovesForColoren(bool white) {
         std::vector<Move> allPossibleMoves;
@@ -1227,11 +1751,197 @@ public:
     }
 
 
+    static std::string squareName(uint64_t square) {
+        int index = bitScanForward(square);
+        return std::string(1, static_cast<char>('a' + index % 8)) + static_cast<char>('1' + index / 8);
+    }
+
+    // Long algebraic notation as UCI writes it: e2e4, e1g1 for castling, e7e8q for a promotion
+    std::string moveToUci(const Move &move) const {
+        if (!move.pieceMoved) return "0000";
+        if (move.castle) return squareName(move.kingFromSquare) + squareName(move.kingToSquare);
+        std::string name = squareName(move.fromSquare) + squareName(move.toSquare);
+        if (move.promotion && move.promotedTo) {
+            if (move.promotedTo == &whiteKnights || move.promotedTo == &blackKnights) name += 'n';
+            else if (move.promotedTo == &whiteBishops || move.promotedTo == &blackBishops) name += 'b';
+            else if (move.promotedTo == &whiteRooks || move.promotedTo == &blackRooks) name += 'r';
+            else name += 'q';
+        }
+        return name;
+    }
+
+    // Standard algebraic notation: Nbd7, exd5, O-O, e8=Q+, Qh7#. move has to be legal in this position.
+    std::string moveToSan(const Move &move) {
+        uint64_t from = move.castle ? move.kingFromSquare : move.fromSquare;
+        bool white = (whitePieces & from) != 0;
+        std::string san;
+        if (move.castle) {
+            san = bitScanForward(move.kingToSquare) % 8 == 6 ? "O-O" : "O-O-O";
+        } else {
+            PieceType type = getPieceTypeOnSquare(bitScanForward(move.fromSquare));
+            if (type == Pawn) {
+                if (move.capture) san = squareName(move.fromSquare).substr(0, 1);
+            } else {
+                san = std::string(1, "PNBRQK"[type]);
+                // Name the file, the rank or both when another piece of the same kind can go there too
+                bool ambiguous = false, sameFile = false, sameRank = false;
+                for (const Move &other: generateMovesForColoren(white)) {
+                    if (other.castle || other.pieceMoved != move.pieceMoved || other.toSquare != move.toSquare ||
+                        other.fromSquare == move.fromSquare) continue;
+                    ambiguous = true;
+                    sameFile |= bitScanForward(other.fromSquare) % 8 == bitScanForward(move.fromSquare) % 8;
+                    sameRank |= bitScanForward(other.fromSquare) / 8 == bitScanForward(move.fromSquare) / 8;
+                }
+                std::string fromName = squareName(move.fromSquare);
+                if (ambiguous && (!sameFile || sameRank)) san += fromName[0];
+                if (sameFile) san += fromName[1];
+            }
+            if (move.capture) san += 'x';
+            san += squareName(move.toSquare);
+            if (move.promotion && move.promotedTo) {
+                san += '=';
+                san += static_cast<char>(std::toupper(moveToUci(move).back()));
+            }
+        }
+        movePiece(move);
+        if (isKingInCheck(!white)) {
+            san += generateMovesForColoren(!white).empty() ? '#' : '+';
+        }
+        resetPreviousMove();
+        return san;
+    }
+
+    // The legal move for white or black written as SAN (check marks and annotations optional) or UCI.
+    // SAN is matched by its parts against the legal moves, so parsing a game stays one generation per move.
+    bool parseMove(const std::string &text, bool white, Move &move) {
+        std::vector<Move> legalMoves = generateMovesForColoren(white);
+        for (const Move &candidate: legalMoves) {
+            if (moveToUci(candidate) == text) {
+                move = candidate;
+                return true;
+            }
+        }
+        std::string san;
+        for (char c: text) {
+            if (c == '+' || c == '#' || c == '!' || c == '?' || c == '=' || c == 'x') continue;
+            san += c == '0' ? 'O' : c;
+        }
+        if (san == "O-O" || san == "O-O-O") {
+            for (const Move &candidate: legalMoves) {
+                if (candidate.castle && (bitScanForward(candidate.kingToSquare) % 8 == 6) == (san == "O-O")) {
+                    move = candidate;
+                    return true;
+                }
+            }
+            return false;
+        }
+        PieceType promotion = None;
+        const std::string pieceLetters = "PNBRQK";
+        if (san.size() > 2 && std::isalpha(static_cast<unsigned char>(san.back())) &&
+            std::isdigit(static_cast<unsigned char>(san[san.size() - 2]))) {
+            size_t letter = pieceLetters.find(static_cast<char>(std::toupper(san.back())));
+            if (letter == std::string::npos) return false;
+            promotion = static_cast<PieceType>(letter);
+            san.pop_back();
+        }
+        PieceType type = Pawn;
+        if (!san.empty() && std::isupper(static_cast<unsigned char>(san[0]))) {
+            size_t letter = pieceLetters.find(san[0]);
+            if (letter == std::string::npos) return false;
+            type = static_cast<PieceType>(letter);
+            san.erase(0, 1);
+        }
+        if (san.size() < 2 || san.size() > 4) return false;
+        int toFile = san[san.size() - 2] - 'a', toRank = san[san.size() - 1] - '1';
+        if (toFile < 0 || toFile > 7 || toRank < 0 || toRank > 7) return false;
+        int fromFile = -1, fromRank = -1; // the disambiguation, if any
+        for (size_t i = 0; i + 2 < san.size(); i++) {
+            if (san[i] >= 'a' && san[i] <= 'h') fromFile = san[i] - 'a';
+            else if (san[i] >= '1' && san[i] <= '8') fromRank = san[i] - '1';
+            else return false;
+        }
+        int found = 0;
+        for (const Move &candidate: legalMoves) {
+            if (candidate.castle || candidate.toSquare != 1ULL << (toRank * 8 + toFile)) continue;
+            int from = bitScanForward(candidate.fromSquare);
+            if (getPieceTypeOnSquare(from) != type) continue;
+            if ((fromFile >= 0 && from % 8 != fromFile) || (fromRank >= 0 && from / 8 != fromRank)) continue;
+            PieceType promotedTo = candidate.promotion && candidate.promotedTo
+                                   ? static_cast<PieceType>(zobristIndexFor(candidate.promotedTo) % 6) : None;
+            if (promotedTo != promotion) continue;
+            move = candidate;
+            found++;
+        }
+        return found == 1;
+    }
+
+    // Counts the leaf nodes of the legal move tree, for checking the generators against known numbers
+    uint64_t perft(int depth, bool white) {
+        if (depth == 0) return 1;
+        uint64_t nodes = 0;
+        for (const Move &move: generateMovesForColoren(white)) {
+            if (depth == 1) {
+                nodes++;
+                continue;
+            }
+            movePiece(move);
+            nodes += perft(depth - 1, !white);
+            resetPreviousMove();
+        }
+        return nodes;
+    }
+
+
+    // Iterative deepening from firstDepth to maxDepth for the side to move, without making the move. The
+    // score is from that side's point of view; rootMoves is left empty when it has no legal move. With
+    // searchLimits set the search can stop early, a null pieceMoved then means not even one root move
+    // was searched.
+    Move searchBestMove(bool white, int maxDepth, int firstDepth = 1) {
+        Move bestMove;
+        bestMove.score = 0;
+        searchedNodes = 0;
+        searchAborted = false;
+        searchClock.restart();
+        clearMoveOrdering();
+        // Each iteration leaves its best moves in the TT to order the next one
+        for (int depth = firstDepth; depth <= maxDepth; ++depth) {
+            rootMoves.clear();
+            rootDepth = depth;
+            PROFILE_SCOPE(Search);
+            SEARCH_STAT(sf::Clock iterationClock);
+            int score = alphaBetaNoTime(-INF, INF, depth, !white, true);
+            SEARCH_STAT(searchStats.iterationSeconds.push_back(iterationClock.getElapsedTime().asSeconds()));
+            if (searchAborted) {
+                // The moves finished before the stop are still better than nothing
+                if (!bestMove.pieceMoved && !rootMoves.empty()) bestMove = BestMover;
+                break;
+            }
+            if (rootMoves.empty()) {
+                bestMove.score = score;
+                break;
+            }
+            bestMove = BestMover;
+            bestMove.score = score;
+            if (std::abs(score) >= MATE_BOUND) {
+                break; // A forced mate was found, searching deeper won't change it
+            }
+        }
+        return bestMove;
+    }
+
     void generateBotMoves() {
         Move bestMove;  // This will be used to store the best move found
         int bestScore = INT_MIN;  // Initialize bestScore with the lowest possible value
         sf::Clock clock;
         rootMoves.clear();
+        searchStats = SearchStats();
+        // Known theory costs no search
+        if (bookMove(false, bestMove)) {
+            cout << "Book move " << moveToSan(bestMove) << endl;
+            movePiece(bestMove);
+            whitesTurn = !whitesTurn;
+            return;
+        }
         // int pvSearch(int depth, int alpha, int beta, bool isMaximizer, bool isRoot = false) {
 /*
         alphaBetaNoTime(INT_MIN, INT_MAX, 5, true, true);
@@ -1242,14 +1952,19 @@ public:
         });
         */
 
-        // Generate all possible moves for the current player
-        alphaBetaNoTime(INT_MIN, INT_MAX, 4, true, true);
-        sort(rootMoves.begin(), rootMoves.end(), [](const Move &a, const Move &b) {
-            return a.score > b.score;
-        });
-        bestMove = rootMoves[0];
+        bestMove = searchBestMove(false, searchDepth);
+        if (rootMoves.empty()) {
+            cout << (bestMove.score <= -MATE_BOUND ? "Checkmate" : "Stalemate") << endl;
+            return;
+        }
+        if (bestMove.score >= MATE_BOUND) {
+            cout << "Mate in " << (MATE_SCORE - bestMove.score + 1) / 2 << endl;
+        } else if (bestMove.score <= -MATE_BOUND) {
+            cout << "Mated in " << (MATE_SCORE + bestMove.score) / 2 << endl;
+        }
         cout << "Score: " << bestMove.score << endl;
         cout << "time taken: " << clock.getElapsedTime().asSeconds() << " seconds" << endl;
+        SEARCH_STAT(searchStats.print());
         movePiece(bestMove);
 
 
@@ -1450,23 +2165,14 @@ public:
 
     bool isDiagonalThreat(int targetPosition, bool isEnemyWhite) {
         const std::vector<int> diagonalOffsets = {7, 9, -7, -9};
-        int startRow = targetPosition / 8;
-        int startColumn = targetPosition % 8;
         for (int offset: diagonalOffsets) {
             int currentPosition = targetPosition;
             while (true) {
                 int nextPosition = currentPosition + offset;
                 if (nextPosition < 0 || nextPosition >= 64) break; // Out of bounds
 
-                int nextRow = nextPosition / 8;
-                int nextColumn = nextPosition % 8;
-
-                // Calculate row and column differences to prevent diagonal wrapping
-                if (abs(nextRow - startRow) != abs(nextColumn - startColumn)) break;
-
-                // Update start position for next iteration's comparison
-                startRow = currentPosition / 8;
-                startColumn = currentPosition % 8;
+                // A diagonal step changes the column by exactly one, anything else wrapped around the board
+                if (abs(nextPosition % 8 - currentPosition % 8) != 1) break;
 
                 currentPosition = nextPosition;
 
@@ -1483,23 +2189,14 @@ public:
 
     bool isQueenThreatDiagonal(int targetPosition, bool isEnemyWhite) {
         const std::vector<int> diagonalOffsets = {7, 9, -7, -9};
-        int startRow = targetPosition / 8;
-        int startColumn = targetPosition % 8;
         for (int offset: diagonalOffsets) {
             int currentPosition = targetPosition;
             while (true) {
                 int nextPosition = currentPosition + offset;
                 if (nextPosition < 0 || nextPosition >= 64) break; // Out of bounds
 
-                int nextRow = nextPosition / 8;
-                int nextColumn = nextPosition % 8;
-
-                // Calculate row and column differences to prevent diagonal wrapping
-                if (abs(nextRow - startRow) != abs(nextColumn - startColumn)) break;
-
-                // Update start position for next iteration's comparison
-                startRow = currentPosition / 8;
-                startColumn = currentPosition % 8;
+                // A diagonal step changes the column by exactly one, anything else wrapped around the board
+                if (abs(nextPosition % 8 - currentPosition % 8) != 1) break;
 
                 currentPosition = nextPosition;
 
@@ -1572,115 +2269,299 @@ public:
     }
 
 
-    int getPositionalValue(PieceType pieceType, int position, bool isWhite) {
-        int index = isWhite ? position : (63 - position); // Flip position for black
+    // Packed middlegame/endgame piece-square score, see makeScore
+    static int getPositionalValue(PieceType pieceType, int position, bool isWhite,
+                                  const EvalParams &params = defaultEvalParams) {
+        return params.positionalValue(pieceType, position, isWhite);
+    }
+
+    // Minor pieces count 1, rooks 2 and queens 4, capped for positions with extra promoted pieces
+    int gamePhase() const {
+        int phase = __builtin_popcountll(whiteKnights | blackKnights | whiteBishops | blackBishops)
+                    + 2 * __builtin_popcountll(whiteRooks | blackRooks)
+                    + 4 * __builtin_popcountll(whiteQueens | blackQueens);
+        return std::min(phase, maxGamePhase);
+    }
+
+    // Blends a packed score between its middlegame and endgame halves by the game phase
+    int taperedScore(int score) const {
+        int phase = gamePhase();
+        return (middlegameScore(score) * phase + endgameScore(score) * (maxGamePhase - phase)) / maxGamePhase;
+    }
+
+
+    static constexpr uint64_t notAFile = 0xFEFEFEFEFEFEFEFEULL;
+    static constexpr uint64_t notHFile = 0x7F7F7F7F7F7F7F7FULL;
+
+    static uint64_t northFill(uint64_t bitboard) {
+        bitboard |= bitboard << 8;
+        bitboard |= bitboard << 16;
+        bitboard |= bitboard << 32;
+        return bitboard;
+    }
+
+    static uint64_t southFill(uint64_t bitboard) {
+        bitboard |= bitboard >> 8;
+        bitboard |= bitboard >> 16;
+        bitboard |= bitboard >> 32;
+        return bitboard;
+    }
+
+    static uint64_t whitePawnAttacks(uint64_t pawns) {
+        return ((pawns << 9) & notAFile) | ((pawns << 7) & notHFile);
+    }
+
+    static uint64_t blackPawnAttacks(uint64_t pawns) {
+        return ((pawns >> 7) & notAFile) | ((pawns >> 9) & notHFile);
+    }
+
+    // Doubled, isolated, backward and passed pawns for one side, from set operations on the pawn bitboards
+    template<typename Trace = NoEvalTrace>
+    static int pawnStructureFor(uint64_t ownPawns, uint64_t enemyPawns, bool white,
+                                const EvalParams &params = defaultEvalParams, Trace trace = {}) {
+        int score = 0;
+        uint64_t fileFill = northFill(southFill(ownPawns));
+        uint64_t neighbourFiles = ((fileFill << 1) & notAFile) | ((fileFill >> 1) & notHFile);
+
+        // Every pawn beyond the first on a file is doubled
+        uint64_t behindOwnPawns = white ? southFill(ownPawns) >> 8 : northFill(ownPawns) << 8;
+        int doubled = __builtin_popcountll(ownPawns & behindOwnPawns);
+        score += params.doubledPawnPenalty * doubled;
+        trace.add(EvalTerms::DOUBLED, doubled);
+
+        int isolated = __builtin_popcountll(ownPawns & ~neighbourFiles);
+        score += params.isolatedPawnPenalty * isolated;
+        trace.add(EvalTerms::ISOLATED, isolated);
+
+        // Backward: the stop square is covered by an enemy pawn and no own pawn can ever defend it
+        uint64_t ownAttacks = white ? whitePawnAttacks(ownPawns) : blackPawnAttacks(ownPawns);
+        uint64_t enemyAttacks = white ? blackPawnAttacks(enemyPawns) : whitePawnAttacks(enemyPawns);
+        uint64_t ownAttackSpans = white ? northFill(ownAttacks) : southFill(ownAttacks);
+        uint64_t stops = white ? ownPawns << 8 : ownPawns >> 8;
+        int backward = __builtin_popcountll(stops & enemyAttacks & ~ownAttackSpans);
+        score += params.backwardPawnPenalty * backward;
+        trace.add(EvalTerms::BACKWARD, backward);
+
+        // Passed: no enemy pawn in front on the same or a neighbouring file
+        uint64_t enemyFrontSpans = white ? southFill(enemyPawns) >> 8 : northFill(enemyPawns) << 8;
+        enemyFrontSpans |= ((enemyFrontSpans << 1) & notAFile) | ((enemyFrontSpans >> 1) & notHFile);
+        uint64_t passed = ownPawns & ~enemyFrontSpans;
+        while (passed) {
+            int square = bitScanForward(passed);
+            passed &= passed - 1;
+            int relativeRank = white ? square / 8 : 7 - square / 8;
+            score += params.passedPawnBonus[relativeRank];
+            trace.add(EvalTerms::PASSED + relativeRank, 1);
+        }
+        return score;
+    }
+
+    // White minus black pawn structure, packed, from the pawn hash table when possible
+    int pawnStructureScore(const EvalParams &params) {
+        SEARCH_STAT(searchStats.pawnHashProbes++);
+        PawnHashTable::Entry &entry = pawnHashTable.entryFor(pawnKey);
+        if (entry.pawnKey == pawnKey) {
+            SEARCH_STAT(searchStats.pawnHashHits++);
+            return entry.score;
+        }
+        int score = pawnStructureFor(whitePawns, blackPawns, true, params)
+                    - pawnStructureFor(blackPawns, whitePawns, false, params);
+        entry = {pawnKey, score};
+        return score;
+    }
+
+    int pawnStructureScore() {
+        return pawnStructureScore(activeEvalParams());
+    }
+
+    // Sliding attacks along one ray, cut off behind the first blocker
+    static uint64_t rayAttacks(int direction, int square, uint64_t occupied) {
+        uint64_t ray = attackTables.rays[direction][square];
+        uint64_t blockers = ray & occupied;
+        if (blockers) {
+            int blocker = direction < 4 ? bitScanForward(blockers) : 63 - __builtin_clzll(blockers);
+            ray ^= attackTables.rays[direction][blocker];
+        }
+        return ray;
+    }
+
+    static uint64_t bishopAttacks(int square, uint64_t occupied) {
+        return rayAttacks(1, square, occupied) | rayAttacks(3, square, occupied)
+               | rayAttacks(5, square, occupied) | rayAttacks(7, square, occupied);
+    }
+
+    static uint64_t rookAttacks(int square, uint64_t occupied) {
+        return rayAttacks(0, square, occupied) | rayAttacks(2, square, occupied)
+               | rayAttacks(4, square, occupied) | rayAttacks(6, square, occupied);
+    }
+
+    static uint64_t attacksFrom(PieceType pieceType, int square, uint64_t occupied) {
         switch (pieceType) {
-            case Pawn:
-                return pawnPositionalValue[index];
             case Knight:
-                return knightPositionalValue[index];
+                return attackTables.knight[square];
             case Bishop:
-                return bishopPositionalValue[index];
+                return bishopAttacks(square, occupied);
             case Rook:
-                return rookPositionalValue[index];
+                return rookAttacks(square, occupied);
             case Queen:
-                return queenPositionalValue[index];
+                return bishopAttacks(square, occupied) | rookAttacks(square, occupied);
+            case King:
+                return attackTables.king[square];
             default:
                 return 0;
         }
     }
 
+    struct AttackInfo {
+        uint64_t byPiece[2][King + 1]; // index 0 white
+        uint64_t all[2];
+    };
+
+    // Builds one side's attack sets, one attack bitboard per piece, and scores its mobility and
+    // its attack on the enemy king zone along the way
+    template<typename Trace = NoEvalTrace>
+    int pieceAttacksFor(int side, AttackInfo &info, const EvalParams &params, Trace trace = {}) {
+        bool white = side == 0;
+        uint64_t occupied = whitePieces | blackPieces;
+        uint64_t enemyPawnAttacks = white ? blackPawnAttacks(blackPawns) : whitePawnAttacks(whitePawns);
+        uint64_t mobilityArea = ~(white ? whitePieces : blackPieces) & ~enemyPawnAttacks;
+        uint64_t enemyKing = white ? blackKing : whiteKing;
+        uint64_t kingZone = enemyKing ? attackTables.king[bitScanForward(enemyKing)] | enemyKing : 0;
 
-    int evaluateBoard(bool isWhite) {
         int score = 0;
-        for (int i = 0; i < 64; i++) {
-            uint64_t position = 1ULL << i;
-            PieceType pieceType = getPieceTypeOnSquare(i);
-            bool isWhitePiece = isSquareOccupiedByWhite(i);
-            if (isWhitePiece == isWhite && pieceType != None) {
-                int pieceValue = getPieceValue(pieceType);
-                score += pieceValue + getPositionalValue(pieceType, i, isWhite);
-
-                if (isSquareThreatened(i, isWhite)) {
-                    bool reverseThreatBackup = isSquareThreatened(i, isWhite);
-                    bool pawnSupport = hasPawnSupport(i, isWhitePiece);
-                    bool backup = reverseThreatBackup || pawnSupport;
-                    int threatValue = getPieceValue(findMostSignificantThreateningPieceType(i, !isWhite));
-                    // Adjust score based on threat and backup status; consider refining this logic
-                    int difference = pieceValue - threatValue;
-                    if (!backup) {
-                        if (difference > 13) {
-                            score -= pieceValue * 4;
-                        } else {
-                            score -= pieceValue * 2;
-                        }
-                    } else {
-                        if (difference > 12) {
-                            score -= pieceValue * 2;
-                        }
-                    }
+        int kingAttackers = 0;
+        int kingAttackTotal = 0;
+        info.byPiece[side][Pawn] = white ? whitePawnAttacks(whitePawns) : blackPawnAttacks(blackPawns);
+        info.all[side] = info.byPiece[side][Pawn];
+        for (int type = Knight; type <= King; type++) {
+            PieceType pieceType = static_cast<PieceType>(type);
+            uint64_t pieces = *getBitboardPointerByPieceType(pieceType, white);
+            while (pieces) {
+                int square = bitScanForward(pieces);
+                pieces &= pieces - 1;
+                uint64_t attacks = attacksFrom(pieceType, square, occupied);
+                info.byPiece[side][type] |= attacks;
+                int mobility = __builtin_popcountll(attacks & mobilityArea) - params.mobilityBaseline[type];
+                score += params.mobilityBonus[type] * mobility;
+                trace.add(EvalTerms::MOBILITY + type, mobility);
+                if (attacks & kingZone) {
+                    kingAttackers++;
+                    kingAttackTotal += params.kingAttackWeight[type];
                 }
-            } else if (pieceType != None) {
-                score -= getPieceValue(pieceType);
             }
+            info.all[side] |= info.byPiece[side][type];
+        }
+        // A lone attacker is rarely dangerous
+        if (kingAttackers >= 2) {
+            score += makeScore(params.kingDangerBonus[std::min(kingAttackTotal, 15)], 0);
+            trace.add(EvalTerms::KING_DANGER + std::min(kingAttackTotal, 15), 1);
         }
         return score;
     }
 
+    // Hanging, defended and threatened pieces of one side, from both sides' attack sets
+    template<typename Trace = NoEvalTrace>
+    int threatsFor(int side, const AttackInfo &info, const EvalParams &params, Trace trace = {}) {
+        bool white = side == 0;
+        int enemy = 1 - side;
+        uint64_t pieces = white ? whitePieces & ~whiteKing : blackPieces & ~blackKing;
+        uint64_t nonPawns = pieces & ~(white ? whitePawns : blackPawns);
+        uint64_t majors = white ? whiteRooks | whiteQueens : blackRooks | blackQueens;
 
-    int evaluateBoardForWhitePieces() {
-        int score = 0;
-        for (int i = 0; i < 64; i++) {
-            uint64_t position = 1ULL << i;
-            PieceType pieceType = getPieceTypeOnSquare(i);
-            bool isWhitePiece = isSquareOccupiedByWhite(i);
-
-            // Focus on white pieces
-            if (isWhitePiece && pieceType != None) {
-                int pieceValue = getPieceValue(pieceType);
-                int positionalValue = getPositionalValue(pieceType, i, isWhitePiece);
-                score += pieceValue + positionalValue;
-
-                // If the piece is threatened, adjust the score
-                if (isSquareThreatened(i, isWhitePiece)) {
-                    bool reverseThreatBackup = isSquareThreatened(i, !isWhitePiece);
-                    bool pawnSupport = hasPawnSupport(i, isWhitePiece);
-                    bool backup = reverseThreatBackup || pawnSupport;
-                    if (!backup) {
-                        score -= 15;
-                    } else {
-                        score -= 5;
-                    }
-                }
-            }
-            score -= getPieceValue(pieceType);
-        }
-        return score;
+        int hanging = __builtin_popcountll(pieces & info.all[enemy] & ~info.all[side]);
+        int defended = __builtin_popcountll(nonPawns & info.all[side]);
+        int threatenedByPawn = __builtin_popcountll(nonPawns & info.byPiece[enemy][Pawn]);
+        uint64_t enemyMinorAttacks = info.byPiece[enemy][Knight] | info.byPiece[enemy][Bishop];
+        int threatenedByMinor = __builtin_popcountll(majors & enemyMinorAttacks);
+        trace.add(EvalTerms::HANGING, hanging);
+        trace.add(EvalTerms::DEFENDED, defended);
+        trace.add(EvalTerms::THREATENED_BY_PAWN, threatenedByPawn);
+        trace.add(EvalTerms::THREATENED_BY_MINOR, threatenedByMinor);
+        return params.hangingPiecePenalty * hanging + params.defendedPieceBonus * defended
+               + params.threatenedByPawnPenalty * threatenedByPawn
+               + params.threatenedByMinorPenalty * threatenedByMinor;
     }
 
-    int shortEvalBoard(bool white) {
-        int score = 0;
-        int enemies = 0;
-        int friendlys = 0;
-        int TotalFriendlyPieceValue = 0;
-        int TotalEnemyPieceValue = 0;
-        for (int i = 0; i < 64; i++) {
-            uint64_t position = 1ULL << i;
-            PieceType pieceType = getPieceTypeOnSquare(i);
-            bool isWhitePiece = isSquareOccupiedByWhite(i);
-            if (isWhitePiece == white && pieceType != None) {
-                score += getPositionalValue(pieceType, i, isWhitePiece);
-                score += getPieceValue(pieceType) * 4;
-                friendlys++;
-            } else {
-                score -= getPieceValue(pieceType);
-                enemies++;
-            }
-        }
+    // White minus black mobility, king safety and threat terms, packed
+    int attackScore(const EvalParams &params) {
+        AttackInfo info{};
+        int score = pieceAttacksFor(0, info, params);
+        score -= pieceAttacksFor(1, info, params);
+        return score + threatsFor(0, info, params) - threatsFor(1, info, params);
+    }
+
+    int attackScore() {
+        return attackScore(activeEvalParams());
+    }
+
+    // Material, PST, pawn structure and attack terms
+    int evaluateBoard(bool isWhite) {
+        int side = isWhite ? 0 : 1;
+        int structure = pawnStructureScore() + attackScore();
+        if (!isWhite) structure = -structure;
+        return materialScore[side] + taperedScore(positionalScore[side] + structure) - materialScore[1 - side];
+    }
+
+
+    int evaluateBoardForWhitePieces() {
+        // White's own material cancels out, the old loop subtracted every piece on the board
+        const EvalParams &params = activeEvalParams();
+        AttackInfo info{};
+        pieceAttacksFor(0, info, params);
+        pieceAttacksFor(1, info, params);
+        return taperedScore(positionalScore[0] + threatsFor(0, info, params)) - materialScore[1];
+    }
+
+    // Own pieces count four times their value, every square not holding one of ours counts -2.
+    // Lazy: when the incremental material, PST and pawn structure score is already more than
+    // lazyEvalMargin outside (alpha, beta) the attack terms are not expected to bring it back, so they're skipped.
+    // Full scores are cached by hash; the two sides' scores aren't negations of each other, so black's
+    // are stored under the complemented key.
+    int shortEvalBoard(bool white, int alpha = -INF, int beta = INF) {
+        SEARCH_STAT(searchStats.evalCalls++);
+        PROFILE_SCOPE(Evaluate);
+        if (useNnue && nnue.loaded()) {
+            return nnueEvaluation(white);
+        }
+        uint64_t cacheKey = white ? hashKey : ~hashKey;
+        int cachedScore;
+        SEARCH_STAT(searchStats.evalCacheProbes++);
+        if (evalCache.probe(cacheKey, cachedScore)) {
+            SEARCH_STAT(searchStats.evalCacheHits++);
+            return cachedScore;
+        }
+        // Loaded weights get an instantiation of their own, the default one keeps evaluating against constants
+        return evalParams ? shortEvalBoardWith<true>(white, alpha, beta, cacheKey)
+                          : shortEvalBoardWith<false>(white, alpha, beta, cacheKey);
+    }
+
+    template<bool CustomParams>
+    int shortEvalBoardWith(bool white, int alpha, int beta, uint64_t cacheKey) {
+        const EvalParams &params = CustomParams ? *evalParams : defaultEvalParams;
+        int side = white ? 0 : 1;
+        int friendlys = pieceCount[side];
+        int enemies = 64 - friendlys;
+        int pawnStructure = white ? pawnStructureScore(params) : -pawnStructureScore(params);
+        int cheapScore = taperedScore(positionalScore[side] + pawnStructure) + materialScore[side] * 4
+                         - materialScore[1 - side] + (friendlys - enemies) * 2;
+        if (lazyEvalMargin > 0 && (cheapScore + lazyEvalMargin <= alpha || cheapScore - lazyEvalMargin >= beta)) {
+            SEARCH_STAT(searchStats.lazyEvals++);
+            return cheapScore;
+        }
+        SEARCH_STAT(searchStats.fullEvals++);
+        int attacks = white ? attackScore(params) : -attackScore(params);
+        int score = taperedScore(positionalScore[side] + pawnStructure + attacks) + materialScore[side] * 4
+                    - materialScore[1 - side];
         score += (friendlys - enemies) * 2;
+        evalCache.store(cacheKey, score);
         return score;
     }
 
+    // shortEvalBoard from the side to move's point of view, lazy for the window (alpha, beta)
+    int lazyEvaluation(bool isMaximizer, int alpha, int beta) {
+        return isMaximizer ? shortEvalBoard(false, alpha, beta) : -shortEvalBoard(false, -beta, -alpha);
+    }
+
 
     void printPieceType(PieceType pieceType) {
         switch (pieceType) {
@@ -1822,39 +2703,369 @@ public:
         return orderedMoves;
     }
 
-    int alphaBetaNoTime(int alpha, int beta, int depth, bool isMaximizer, bool root) {
-        if (depth == 0) {
-            return shortEvalBoard(false);
+    // Search tuning. Scores inside the search are always from the side to move's point of view,
+    // so every bound has to stay well inside int range when it gets negated.
+    static const int INF = 1000000;
+    static const int MATE_SCORE = 900000;          // mated at ply p scores -MATE_SCORE + p
+    static const int MATE_BOUND = MATE_SCORE - 1000; // anything beyond this is a mate score
+    // Move ordering, best first: winning captures, queen promotions, the two killers, the other quiet moves
+    // by history score (within +-HISTORY_MAX), then the losing captures
+    static const int CAPTURE_ORDER = 30000;
+    static const int QUEEN_PROMOTION_ORDER = 25000;
+    static const int KILLER_ORDER = 20000;
+    static const int HISTORY_MAX = 16000;
+    static const int LOSING_CAPTURE_ORDER = -30000;
+    static const int MAX_PLY = 128;                  // killers are kept for this many plies from the root
+    // Depth of the bot's search, the deepest that stays within the time the original depth 4 search took
+    int searchDepth = 5;
+    int rootDepth = 0;             // depth of the current iterative deepening iteration
+    int singularMinDepth = 5;      // singular extensions need a TT entry from a search at least this deep
+    int singularMargin = 2;        // per ply of depth, how far below the TT score the other moves must stay
+    int drawScore = 0;             // repetitions, the fifty-move rule and stalemate
+    // How far the attack terms (mobility, king safety, threats) are allowed to move the score. Their weights
+    // allow far more in theory; the largest measured over random games from the bench positions was 53, so
+    // this leaves headroom. 0 turns lazy evaluation off.
+    int lazyEvalMargin = 8 * pawnValue;
+    int nullMoveMinDepth = 3;      // don't try a null move with less depth than this left
+    int nullMoveReduction = 2;     // R, the null move is searched at depth - 1 - R
+    int lmrMinDepth = 3;           // late move reductions only kick in from this depth
+    int lmrFullDepthMoves = 3;     // the first moves from the ordered list are never reduced
+    double lmrBase = 0.75;
+    double lmrDivisor = 2.25;
+    // Frontier pruning, a max depth of 0 turns the technique off
+    int reverseFutilityMaxDepth = 3;
+    int reverseFutilityMargin = 4 * pawnValue;  // per ply of depth left
+    int razorMaxDepth = 2;
+    int razorMargin = 8 * pawnValue;            // per ply of depth left
+    int futilityMaxDepth = 2;
+    int futilityMargin = 5 * pawnValue;         // per ply of depth left
+    int lateMovePruningMaxDepth = 3;
+    int lateMovePruningBase = 4;                // quiet moves tried before depth * depth more are allowed
+    int lmrReductions[64][64] = {};
+    uint16_t killerMoves[MAX_PLY][2] = {}; // moveCode of the last two quiet moves that cut off at each ply
+    int historyScores[2][64][64] = {};      // by side, from and to square: how often a quiet move cut off
+
+    // Optional bounds on one searchBestMove call, 0 or nullptr for none. A search that runs into one
+    // returns the best move of the last iteration it finished.
+    struct SearchLimits {
+        long long nodes = 0;
+        double seconds = 0;
+        const std::atomic<bool> *stop = nullptr; // set from another thread to stop the search
+    };
+    SearchLimits searchLimits;
+    long long searchedNodes = 0; // nodes and qnodes of the current searchBestMove call, counted for the limits
+    bool searchAborted = false;
+    sf::Clock searchClock;
+
+    // Counts a node and tells whether the search has to stop. The limits are only looked at every 1024
+    // nodes, once a limit is hit every node returns straight away.
+    bool searchLimitReached() {
+        if (searchAborted) return true;
+        if ((++searchedNodes & 1023) != 0) return false;
+        searchAborted = (searchLimits.nodes > 0 && searchedNodes >= searchLimits.nodes) ||
+                        (searchLimits.seconds > 0 && searchClock.getElapsedTime().asSeconds() >= searchLimits.seconds) ||
+                        (searchLimits.stop && searchLimits.stop->load(std::memory_order_relaxed));
+        return searchAborted;
+    }
+
+    // Builds the reduction table from lmrBase/lmrDivisor, call it again after changing them
+    void initLmrTable() {
+        for (int depth = 1; depth < 64; ++depth) {
+            for (int moveNumber = 1; moveNumber < 64; ++moveNumber) {
+                lmrReductions[depth][moveNumber] =
+                        static_cast<int>(lmrBase + std::log(depth) * std::log(moveNumber) / lmrDivisor);
+            }
         }
-        if (isMaximizer) {
-            int maxEval = INT_MIN;
-            auto moves = generateMovesForColor(false); // Generate moves for black
-            for (auto& move : moves) {
-                movePiece(move); // Apply the move
-                int eval = alphaBetaNoTime(alpha, beta, depth - 1, false, false); // Recurse for minimizing player
-                if (root) { // If this is the root, save the move and its score
-                    move.score = eval; // Set the move's score
-                    rootMoves.push_back(move); // Add the move to rootMoves
+    }
+
+    // Pawn-only (and king-only) positions are where zugzwang lives, so no null moves there
+    bool hasNonPawnMaterial(bool white) const {
+        return white ? (whiteKnights | whiteBishops | whiteRooks | whiteQueens) != 0
+                     : (blackKnights | blackBishops | blackRooks | blackQueens) != 0;
+    }
+
+    // Mate scores are stored relative to the node in the TT so they stay correct at other plies
+    static int valueToTT(int value, int ply) {
+        if (value >= MATE_BOUND) return value + ply;
+        if (value <= -MATE_BOUND) return value - ply;
+        return value;
+    }
+
+    static int valueFromTT(int value, int ply) {
+        if (value >= MATE_BOUND) return value - ply;
+        if (value <= -MATE_BOUND) return value + ply;
+        return value;
+    }
+
+    // 16 bit identity of a move: from square, to square and the kind in the top 4 bits, 0 for a plain move,
+    // 1-4 for a promotion to knight..queen and 5 for castling, which uses the king's squares
+    uint16_t moveCode(const Move &move) const {
+        int kind = move.castle ? 5 : move.promotion ? zobristIndexFor(move.promotedTo) % 6 : 0;
+        int from = bitScanForward(move.castle ? move.kingFromSquare : move.fromSquare);
+        int to = bitScanForward(move.castle ? move.kingToSquare : move.toSquare);
+        return static_cast<uint16_t>(kind << 12 | from << 6 | to);
+    }
+
+    // Scores the quiet moves by killer and history and sorts the list again, the captures and promotions
+    // keep the scores the generator gave them
+    void orderQuietMoves(std::vector<Move> &moves, bool white, int ply) {
+        for (Move &move: moves) {
+            if (move.capture || move.promotion || move.castle) continue;
+            uint16_t code = moveCode(move);
+            if (ply < MAX_PLY && code == killerMoves[ply][0]) {
+                move.score = KILLER_ORDER + 1;
+            } else if (ply < MAX_PLY && code == killerMoves[ply][1]) {
+                move.score = KILLER_ORDER;
+            } else {
+                move.score = historyScores[white ? 0 : 1][code >> 6 & 63][code & 63];
+            }
+        }
+        std::stable_sort(moves.begin(), moves.end(), [](const Move &a, const Move &b) {
+            return a.score > b.score;
+        });
+    }
+
+    // Moves a history score towards +-HISTORY_MAX, the closer it already is the smaller the step
+    static void updateHistory(int &score, int bonus) {
+        score += bonus - score * std::abs(bonus) / HISTORY_MAX;
+    }
+
+    // A quiet move cut off: it becomes the first killer of its ply and gains history, the quiet moves
+    // searched before it without a cutoff lose some
+    void recordQuietCutoff(uint16_t code, bool white, int ply, int depth, const uint16_t *triedQuiets, int tried) {
+        if (ply < MAX_PLY && killerMoves[ply][0] != code) {
+            killerMoves[ply][1] = killerMoves[ply][0];
+            killerMoves[ply][0] = code;
+        }
+        int side = white ? 0 : 1;
+        int bonus = std::min(depth * depth, 400);
+        updateHistory(historyScores[side][code >> 6 & 63][code & 63], bonus);
+        for (int i = 0; i < tried; i++) {
+            updateHistory(historyScores[side][triedQuiets[i] >> 6 & 63][triedQuiets[i] & 63], -bonus);
+        }
+    }
+
+    // Negamax alpha-beta, isMaximizer is true when black (the bot) is to move.
+    // The returned score is from the side to move's point of view, so at the root
+    // (black to move) it is the same black-relative score shortEvalBoard(false) gives.
+    // excludedMove is set by the singular extension search, which re-searches a node without its TT move.
+    int alphaBetaNoTime(int alpha, int beta, int depth, bool isMaximizer, bool root, int ply = 0,
+                        bool allowNull = true, const Move *excludedMove = nullptr) {
+        // Every call is a node, the leaves and tablebase hits included
+        if (searchLimitReached()) {
+            return 0; // Thrown away with the rest of the unfinished iteration
+        }
+        SEARCH_STAT(searchStats.nodes++);
+        // Few enough pieces for the endgame tables: the exact result, at the leaves too
+        int tablebaseScore;
+        if (!root && probeTablebase(!isMaximizer, ply, tablebaseScore)) {
+            SEARCH_STAT(searchStats.tablebaseHits++);
+            return isDrawByRule(ply) ? drawScore : tablebaseScore;
+        }
+        if (depth <= 0) {
+            return lazyEvaluation(isMaximizer, alpha, beta);
+        }
+        bool white = !isMaximizer;
+
+        if (!root && isDrawByRule(ply)) {
+            return drawScore;
+        }
+
+        // Mate distance pruning: no line from here can beat a mate that was already found closer to the root
+        if (!root) {
+            alpha = std::max(alpha, -MATE_SCORE + ply);
+            beta = std::min(beta, MATE_SCORE - ply - 1);
+            if (alpha >= beta) {
+                return alpha;
+            }
+        }
+
+        int alphaOriginal = alpha;
+        // Copied out of the table: the null move and child searches below store into it and can overwrite
+        // the slot with another position
+        TTEntry ttEntry{};
+        const TTEntry *ttSlot = excludedMove ? nullptr : transpositionTable.get(hashKey);
+        if (ttSlot) ttEntry = *ttSlot;
+        bool ttHit = ttSlot && ttEntry.hashKey == hashKey;
+        SEARCH_STAT(if (!excludedMove) searchStats.ttProbes++);
+        SEARCH_STAT(if (ttHit) searchStats.ttHits++);
+        if (ttHit && !root && ttEntry.depth >= depth) {
+            int ttValue = valueFromTT(ttEntry.value, ply);
+            if (ttEntry.flag == EXACT ||
+                (ttEntry.flag == LOWERBOUND && ttValue >= beta) ||
+                (ttEntry.flag == UPPERBOUND && ttValue <= alpha)) {
+                SEARCH_STAT(searchStats.ttCutoffs++);
+                return ttValue;
+            }
+        }
+
+        bool inCheck = isKingInCheck(white);
+        bool frontier = !root && !inCheck && !excludedMove;
+        int staticEval = frontier ? (isMaximizer ? shortEvalBoard(false) : -shortEvalBoard(false)) : -INF;
+
+        // Reverse futility (static null move): so far above beta that a shallow search won't bring us back
+        if (frontier && depth <= reverseFutilityMaxDepth && beta < MATE_BOUND &&
+            staticEval - reverseFutilityMargin * depth >= beta) {
+            SEARCH_STAT(searchStats.reverseFutilityPrunes++);
+            return staticEval;
+        }
+
+        // Razoring: hopelessly below alpha, let quiescence decide if a capture saves us
+        if (frontier && depth <= razorMaxDepth && alpha > -MATE_BOUND &&
+            staticEval + razorMargin * depth <= alpha) {
+            int eval = quiesce(alpha, beta, isMaximizer);
+            if (eval <= alpha) {
+                SEARCH_STAT(searchStats.razorPrunes++);
+                return eval;
+            }
+        }
+
+        // Null move pruning: give the opponent a free move, if we are still above beta
+        // with a reduced search the real moves will be too
+        if (allowNull && frontier && depth >= nullMoveMinDepth && beta < MATE_BOUND && hasNonPawnMaterial(white)) {
+            if (staticEval >= beta) {
+                int nullDepth = depth - 1 - nullMoveReduction;
+                NullMoveUndo undo = makeNullMove();
+                int eval = -alphaBetaNoTime(-beta, -beta + 1, nullDepth, !isMaximizer, false, ply + 1, false);
+                unmakeNullMove(undo);
+                SEARCH_STAT(searchStats.nullMoveSearches++);
+                if (eval >= beta) {
+                    SEARCH_STAT(searchStats.nullMoveCutoffs++);
+                    return beta;
                 }
-                maxEval = std::max(maxEval, eval);
-                alpha = std::max(alpha, eval);
-                resetPreviousMove(); // Undo the move
-                if (alpha >= beta) break; // Alpha-beta pruning
             }
-            return maxEval;
-        } else {
-            int minEval = INT_MAX;
-            auto moves = generateMovesForColor(true); // Generate moves for white
-            for (const auto& move : moves) {
-                movePiece(move);
-                int eval = alphaBetaNoTime(alpha, beta, depth - 1, true, false); // Recurse for maximizing player
-                minEval = std::min(minEval, eval);
-                beta = std::min(beta, eval);
-                resetPreviousMove();
-                if (beta <= alpha) break;
+        }
+
+        // Futility: quiet moves can't lift a position this far below alpha in the plies left
+        bool futile = frontier && depth <= futilityMaxDepth && alpha > -MATE_BOUND &&
+                      staticEval + futilityMargin * depth <= alpha;
+        int lateMoveLimit = lateMovePruningBase + depth * depth;
+
+        auto moves = generateMovesForColor(white);
+        if (moves.empty()) {
+            return inCheck ? -MATE_SCORE + ply : drawScore; // Checkmate or stalemate
+        }
+        orderQuietMoves(moves, white, ply);
+
+        // Try the TT move first, and find out if it is singular: if every other move fails well
+        // below its score in a reduced search, it is the only move and gets searched one ply deeper
+        bool ttMoveSingular = false;
+        if (ttHit && ttEntry.bestMove) {
+            auto ttMove = std::find_if(moves.begin(), moves.end(), [&](const Move &move) {
+                return moveCode(move) == ttEntry.bestMove;
+            });
+            if (ttMove != moves.end()) {
+                std::rotate(moves.begin(), ttMove, ttMove + 1);
+                int ttValue = valueFromTT(ttEntry.value, ply);
+                if (!root && !excludedMove && depth >= singularMinDepth && ttEntry.depth >= depth - 3 &&
+                    ttEntry.flag != UPPERBOUND && std::abs(ttValue) < MATE_BOUND) {
+                    Move candidate = moves.front();
+                    int singularBeta = ttValue - singularMargin * depth;
+                    int eval = alphaBetaNoTime(singularBeta - 1, singularBeta, (depth - 1) / 2, isMaximizer, false,
+                                               ply, false, &candidate);
+                    ttMoveSingular = eval < singularBeta;
+                }
             }
-            return minEval;
         }
+
+        int bestEval = -INF;
+        Move bestMove;
+        int moveNumber = 0;
+        int quietMoves = 0;
+        int searchedMoves = 0;
+        uint16_t triedQuiets[64];
+        int triedQuietCount = 0;
+        for (auto &move: moves) {
+            if (excludedMove && move.sameAs(*excludedMove)) continue;
+            moveNumber++;
+            bool quiet = !move.capture && !move.promotion && !move.castle;
+            if (quiet) quietMoves++;
+            movePiece(move); // Apply the move
+            bool givesCheck = isKingInCheck(!white);
+            if (quiet && !givesCheck && moveNumber > 1) {
+                if (futile) {
+                    resetPreviousMove();
+                    SEARCH_STAT(searchStats.futilityPrunes++);
+                    continue;
+                }
+                // Late move pruning: the quiet moves come in history order, and one this far down that has
+                // not been cutting off elsewhere (history <= 0) rarely matters this close to the horizon
+                if (frontier && depth <= lateMovePruningMaxDepth && quietMoves > lateMoveLimit &&
+                    move.score <= 0) {
+                    resetPreviousMove();
+                    SEARCH_STAT(searchStats.lateMovePrunes++);
+                    continue;
+                }
+            }
+            searchedMoves++;
+            // Check extension, capped so perpetual checks can't make the search run away
+            int extension = 0;
+            if (givesCheck && ply < 2 * rootDepth) {
+                extension = 1;
+            } else if (ttMoveSingular && moveNumber == 1) {
+                extension = 1;
+            }
+            int newDepth = depth - 1 + extension;
+            int eval;
+            // Late move reductions: moves far down the ordered list rarely raise alpha, so search them
+            // shallower with a null window. Killers get one ply less of it, quiet moves that have been
+            // failing (negative history) one more. One that beats alpha gets the full depth, still with a
+            // null window, and the full window only if it lands inside it.
+            int reduction = 0;
+            if (!root && !inCheck && quiet && !givesCheck && depth >= lmrMinDepth && moveNumber > lmrFullDepthMoves) {
+                reduction = lmrReductions[std::min(depth, 63)][std::min(moveNumber, 63)];
+                if (move.score >= KILLER_ORDER) reduction--;
+                else if (move.score < 0) reduction++;
+                reduction = std::max(0, std::min(reduction, depth - 2));
+            }
+            if (reduction > 0) {
+                eval = -alphaBetaNoTime(-alpha - 1, -alpha, newDepth - reduction, !isMaximizer, false, ply + 1);
+                SEARCH_STAT(searchStats.lmrSearches++);
+                if (eval > alpha) {
+                    SEARCH_STAT(searchStats.lmrResearches++);
+                    eval = -alphaBetaNoTime(-alpha - 1, -alpha, newDepth, !isMaximizer, false, ply + 1);
+                }
+                if (eval > alpha && eval < beta) {
+                    eval = -alphaBetaNoTime(-beta, -alpha, newDepth, !isMaximizer, false, ply + 1);
+                }
+            } else {
+                eval = -alphaBetaNoTime(-beta, -alpha, newDepth, !isMaximizer, false, ply + 1);
+            }
+            resetPreviousMove(); // Undo the move
+            if (searchAborted) {
+                return 0; // Don't let a half searched subtree into the TT or the root moves
+            }
+            if (root) { // If this is the root, save the move and its score
+                move.score = eval;
+                rootMoves.push_back(move);
+            }
+            if (eval > bestEval) {
+                bestEval = eval;
+                bestMove = move;
+                if (root) {
+                    BestMover = move;
+                }
+            }
+            alpha = std::max(alpha, eval);
+            if (alpha >= beta) { // Beta cut-off
+                SEARCH_STAT(searchStats.betaCutoffs++);
+                SEARCH_STAT(if (searchedMoves == 1) searchStats.firstMoveCutoffs++);
+                if (quiet) recordQuietCutoff(moveCode(move), white, ply, depth, triedQuiets, triedQuietCount);
+                break;
+            }
+            if (quiet && triedQuietCount < 64) triedQuiets[triedQuietCount++] = moveCode(move);
+        }
+        if (searchedMoves == 0) {
+            // Everything was pruned (or the only move was excluded), the static eval is our fail low bound
+            return excludedMove ? alpha : staticEval;
+        }
+
+        if (!excludedMove) {
+            NodeType flag = bestEval <= alphaOriginal ? UPPERBOUND : bestEval >= beta ? LOWERBOUND : EXACT;
+            transpositionTable.store(hashKey, depth, valueToTT(bestEval, ply), flag,
+                                     bestMove.pieceMoved ? moveCode(bestMove) : 0);
+        }
+        return bestEval;
     }
 
 
@@ -1912,7 +3123,7 @@ public:
     }
 
     vector<Move> generateCapturesForColor(bool white){
-        vector<Move> moves = generateMovesForColor(false);
+        vector<Move> moves = generateMovesForColor(white);
         vector<Move> movesss;
         for (auto &move: moves){
             if (move.capture){
@@ -1922,8 +3133,12 @@ public:
         return movesss;
     }
 
-    int quiesce(int alpha, int beta){
-        int stand_pat = shortEvalBoard(false);
+    // Captures-only search at the horizon, same negamax convention as alphaBetaNoTime
+    int quiesce(int alpha, int beta, bool isMaximizer){
+        PROFILE_SCOPE(Quiesce);
+        searchedNodes++;
+        SEARCH_STAT(searchStats.qnodes++);
+        int stand_pat = lazyEvaluation(isMaximizer, alpha, beta);
 
         if (stand_pat >= beta){
             return beta;
@@ -1931,10 +3146,10 @@ public:
         if (alpha < stand_pat){
             alpha = stand_pat;
         }
-        vector<Move> moves = generateCapturesForColor(false);
+        vector<Move> moves = generateCapturesForColor(!isMaximizer);
         for (auto &move: moves){
             movePiece(move);
-            int score = -quiesce(-beta, -alpha);
+            int score = -quiesce(-beta, -alpha, !isMaximizer);
             resetPreviousMove();
             if (score >= beta){
                 return beta;
@@ -2008,3 +3223,4 @@ public:
 
     };
 
+#endif //UNTITLED7_CHESSBOARD_CPP
@@ -0,0 +1,374 @@
+#ifndef UNTITLED7_EVALPARAMS_H
+#define UNTITLED7_EVALPARAMS_H
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Tapered scores: the middlegame value in the low 16 bits and the endgame value in the high 16 bits
+// of one int, so sums of them are still one add.
+constexpr int makeScore(int middlegame, int endgame) {
+    return static_cast<int>(static_cast<unsigned>(endgame) << 16) + middlegame;
+}
+
+constexpr int middlegameScore(int score) {
+    return static_cast<int16_t>(static_cast<uint16_t>(static_cast<unsigned>(score)));
+}
+
+constexpr int endgameScore(int score) {
+    return static_cast<int16_t>(static_cast<uint16_t>(static_cast<unsigned>(score + 0x8000) >> 16));
+}
+
+// Every weight of the classical evaluation. The default member values are the compiled-in weights
+// (defaultEvalParams); a ChessBoard only reads a copy of its own after loadEvalParams or setEvalParam,
+// so the default configuration keeps evaluating against constants.
+//
+// Parameter files hold one weight per line, '#' starts a comment:
+//   knightValue 30
+//   doubledPawnPenalty -2 -4             packed scores take the middlegame and the endgame value
+//   pawnPositionalValue 0 0 0 ... 0      tables take all their values, a1 first
+//   passedPawnBonus 0 0 0 1 1 2 ...      tables of packed scores take middlegame/endgame pairs
+// Weights that aren't mentioned keep their current value.
+struct EvalParams {
+    // Material, indexed pawn..queen by pieceValue()
+    int pawnValue = 10;
+    int knightValue = 28;
+    int bishopValue = 28;
+    int rookValue = 40;
+    int queenValue = 70;
+
+    // Piece-square tables, a1 first and seen from white. The *PositionalValue tables are the middlegame
+    // half and the *EndgameValue tables the endgame half of a tapered score.
+    int pawnPositionalValue[64] = {
+            0, 0, 0, 0, 0, 0, 0, 0,
+            3, 2, 1, -1, -1, -1, 1, 2,
+            2, 2, 4, 6, 6, 4, 2, 2,
+            1, 1, 2, 5, 5, 2, 1, 1,
+            0, 0, 1, 3, 3, 1, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0,
+            5, 5, 5, 5, 5, 5, 5, 5,
+            0, 0, 0, 0, 0, 0, 0, 0,
+    };
+
+
+    // Positional values for knights
+    int knightPositionalValue[64] = {
+            -5, -2, -2, -2, -2, -2, -2, -5,
+            -2, 0, 0, 3, 3, 0, 0, -2,
+            -2, 0, 3, 6, 6, 3, 0, -2,
+            -2, 3, 6, 8, 8, 6, 3, -2,
+            -2, 3, 6, 8, 8, 6, 3, -2,
+            -2, 0, 3, 6, 6, 3, 0, -2,
+            -2, 0, 0, 3, 3, 0, 0, -2,
+            -5, -2, -2, -2, -2, -2, -2, -5,
+    };
+
+
+    int bishopPositionalValue[64] = {
+            -5, -2, -2, -2, -2, -2, -2, -5,
+            -2, 0, 0, 0, 0, 0, 0, -2,
+            -2, 0, 5, 5, 5, 5, 0, -2,
+            -2, 0, 5, 8, 8, 5, 0, -2,
+            -2, 0, 5, 8, 8, 5, 0, -2,
+            -2, 0, 5, 5, 5, 5, 0, -2,
+            -2, 0, 0, 0, 0, 0, 0, -2,
+            -5, -2, -2, -2, -2, -2, -5, -5,
+    };
+
+
+    int rookPositionalValue[64] = {
+            0, 0, 0, 5, 5, 0, 0, 0,
+            5, 10, 10, 5, 5, 10, 10, 5,
+            -5, 0, 0, 5, 5, 0, 0, -5,
+            -5, 0, 0, 5, 5, 0, 0, -5,
+            -5, 0, 0, 5, 5, 0, 0, -5,
+            -5, 0, 0, 5, 5, 0, 0, -5,
+            5, 10, 10, 10, 10, 10, 10, 5,
+            0, 0, 0, 5, 5, 0, 0, 0,
+    };
+
+
+    int queenPositionalValue[64] = {
+            -2, -2, -2, -2, -2, -2, -2, -2,
+            -2, 0, 0, 0, 0, 0, 0, -2,
+            -2, 0, 3, 3, 3, 3, 0, -2,
+            -2, 0, 3, 5, 5, 3, 0, -2,
+            -2, 0, 3, 5, 5, 3, 0, -2,
+            -2, 0, 3, 3, 3, 3, 0, -2,
+            -2, 0, 0, 0, 0, 0, 0, -2,
+            -2, -2, -2, -2, -2, -2, -2, -2,
+    };
+
+
+    int kingPositionalValue[64] = {
+            2, 3, 1, 0, 0, 1, 3, 2,
+            1, 1, 0, 0, 0, 0, 1, 1,
+            -1, -2, -2, -2, -2, -2, -2, -1,
+            -2, -3, -3, -4, -4, -3, -3, -2,
+            -3, -4, -4, -5, -5, -4, -4, -3,
+            -3, -4, -4, -5, -5, -4, -4, -3,
+            -3, -4, -4, -5, -5, -4, -4, -3,
+            -3, -4, -4, -5, -5, -4, -4, -3,
+    };
+
+
+    int pawnEndgameValue[64] = {
+            0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0,
+            1, 1, 1, 1, 1, 1, 1, 1,
+            2, 2, 2, 2, 2, 2, 2, 2,
+            4, 4, 4, 4, 4, 4, 4, 4,
+            7, 7, 7, 7, 7, 7, 7, 7,
+            10, 10, 10, 10, 10, 10, 10, 10,
+            0, 0, 0, 0, 0, 0, 0, 0,
+    };
+
+
+    int knightEndgameValue[64] = {
+            -4, -2, -2, -2, -2, -2, -2, -4,
+            -2, -1, 0, 1, 1, 0, -1, -2,
+            -2, 0, 2, 3, 3, 2, 0, -2,
+            -2, 1, 3, 4, 4, 3, 1, -2,
+            -2, 1, 3, 4, 4, 3, 1, -2,
+            -2, 0, 2, 3, 3, 2, 0, -2,
+            -2, -1, 0, 1, 1, 0, -1, -2,
+            -4, -2, -2, -2, -2, -2, -2, -4,
+    };
+
+
+    int bishopEndgameValue[64] = {
+            -2, -1, -1, -1, -1, -1, -1, -2,
+            -1, 0, 0, 0, 0, 0, 0, -1,
+            -1, 0, 2, 2, 2, 2, 0, -1,
+            -1, 0, 2, 3, 3, 2, 0, -1,
+            -1, 0, 2, 3, 3, 2, 0, -1,
+            -1, 0, 2, 2, 2, 2, 0, -1,
+            -1, 0, 0, 0, 0, 0, 0, -1,
+            -2, -1, -1, -1, -1, -1, -1, -2,
+    };
+
+
+    int rookEndgameValue[64] = {
+            0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0,
+            2, 2, 2, 2, 2, 2, 2, 2,
+            0, 0, 0, 0, 0, 0, 0, 0,
+    };
+
+
+    int queenEndgameValue[64] = {
+            -3, -2, -2, -1, -1, -2, -2, -3,
+            -2, 0, 0, 0, 0, 0, 0, -2,
+            -2, 0, 2, 2, 2, 2, 0, -2,
+            -1, 0, 2, 4, 4, 2, 0, -1,
+            -1, 0, 2, 4, 4, 2, 0, -1,
+            -2, 0, 2, 2, 2, 2, 0, -2,
+            -2, 0, 0, 0, 0, 0, 0, -2,
+            -3, -2, -2, -1, -1, -2, -2, -3,
+    };
+
+
+    // The king should hide while there are pieces around and walk to the centre once they are gone
+    int kingEndgameValue[64] = {
+            -5, -3, -2, -2, -2, -2, -3, -5,
+            -3, -1, 0, 0, 0, 0, -1, -3,
+            -2, 0, 2, 3, 3, 2, 0, -2,
+            -2, 0, 3, 4, 4, 3, 0, -2,
+            -2, 0, 3, 4, 4, 3, 0, -2,
+            -2, 0, 2, 3, 3, 2, 0, -2,
+            -3, -1, 0, 0, 0, 0, -1, -3,
+            -5, -3, -2, -2, -2, -2, -3, -5,
+    };
+
+    // Pawn structure terms, packed like the PST scores
+    int doubledPawnPenalty = makeScore(-2, -4);
+    int isolatedPawnPenalty = makeScore(-2, -3);
+    int backwardPawnPenalty = makeScore(-1, -2);
+    int passedPawnBonus[8] = {
+            0, makeScore(0, 1), makeScore(1, 2), makeScore(1, 3),
+            makeScore(2, 6), makeScore(4, 9), makeScore(6, 14), 0
+    }; // by relative rank
+
+    // Attack terms, packed like the PST scores and indexed pawn..king. Mobility counts the squares a piece
+    // attacks that are neither our own nor covered by an enemy pawn, relative to a typical count for the piece.
+    int mobilityBonus[6] = {
+            0, makeScore(1, 1), makeScore(1, 1), makeScore(0, 1), makeScore(0, 1), 0
+    };
+    int mobilityBaseline[6] = {0, 4, 6, 7, 13, 0};
+    int kingAttackWeight[6] = {0, 2, 2, 3, 5, 0};
+    int kingDangerBonus[16] = {0, 0, 1, 2, 3, 5, 7, 9, 12, 15, 18, 22, 26, 30, 35, 40}; // middlegame only
+    int hangingPiecePenalty = makeScore(-4, -3);
+    int defendedPieceBonus = makeScore(1, 0);
+    int threatenedByPawnPenalty = makeScore(-5, -4);
+    int threatenedByMinorPenalty = makeScore(-3, -3);
+
+    int pieceValue(int pieceType) const {
+        const int values[6] = {pawnValue, knightValue, bishopValue, rookValue, queenValue, 0};
+        return pieceType >= 0 && pieceType < 6 ? values[pieceType] : 0;
+    }
+
+    // Packed middlegame/endgame piece-square score; black squares are looked up rotated
+    int positionalValue(int pieceType, int position, bool white) const {
+        int index = white ? position : (63 - position);
+        switch (pieceType) {
+            case 0:
+                return makeScore(pawnPositionalValue[index], pawnEndgameValue[index]);
+            case 1:
+                return makeScore(knightPositionalValue[index], knightEndgameValue[index]);
+            case 2:
+                return makeScore(bishopPositionalValue[index], bishopEndgameValue[index]);
+            case 3:
+                return makeScore(rookPositionalValue[index], rookEndgameValue[index]);
+            case 4:
+                return makeScore(queenPositionalValue[index], queenEndgameValue[index]);
+            case 5:
+                return makeScore(kingPositionalValue[index], kingEndgameValue[index]);
+            default:
+                return 0;
+        }
+    }
+
+    // Value is int for fields() and const int for fields() const
+    template<typename Value>
+    struct BasicField {
+        const char *name;
+        Value *values;
+        int count;
+        bool packed;
+    };
+    using Field = BasicField<int>;
+
+    std::vector<BasicField<int>> fields() {
+        return fieldsOf<int>(*this);
+    }
+
+    std::vector<BasicField<const int>> fields() const {
+        return fieldsOf<const int>(*this);
+    }
+
+    // One list for both, Self is EvalParams or const EvalParams
+    template<typename Value, typename Self>
+    static std::vector<BasicField<Value>> fieldsOf(Self &self) {
+        return {
+                {"pawnValue", &self.pawnValue, 1, false},
+                {"knightValue", &self.knightValue, 1, false},
+                {"bishopValue", &self.bishopValue, 1, false},
+                {"rookValue", &self.rookValue, 1, false},
+                {"queenValue", &self.queenValue, 1, false},
+                {"pawnPositionalValue", self.pawnPositionalValue, 64, false},
+                {"knightPositionalValue", self.knightPositionalValue, 64, false},
+                {"bishopPositionalValue", self.bishopPositionalValue, 64, false},
+                {"rookPositionalValue", self.rookPositionalValue, 64, false},
+                {"queenPositionalValue", self.queenPositionalValue, 64, false},
+                {"kingPositionalValue", self.kingPositionalValue, 64, false},
+                {"pawnEndgameValue", self.pawnEndgameValue, 64, false},
+                {"knightEndgameValue", self.knightEndgameValue, 64, false},
+                {"bishopEndgameValue", self.bishopEndgameValue, 64, false},
+                {"rookEndgameValue", self.rookEndgameValue, 64, false},
+                {"queenEndgameValue", self.queenEndgameValue, 64, false},
+                {"kingEndgameValue", self.kingEndgameValue, 64, false},
+                {"doubledPawnPenalty", &self.doubledPawnPenalty, 1, true},
+                {"isolatedPawnPenalty", &self.isolatedPawnPenalty, 1, true},
+                {"backwardPawnPenalty", &self.backwardPawnPenalty, 1, true},
+                {"passedPawnBonus", self.passedPawnBonus, 8, true},
+                {"mobilityBonus", self.mobilityBonus, 6, true},
+                {"mobilityBaseline", self.mobilityBaseline, 6, false},
+                {"kingAttackWeight", self.kingAttackWeight, 6, false},
+                {"kingDangerBonus", self.kingDangerBonus, 16, false},
+                {"hangingPiecePenalty", &self.hangingPiecePenalty, 1, true},
+                {"defendedPieceBonus", &self.defendedPieceBonus, 1, true},
+                {"threatenedByPawnPenalty", &self.threatenedByPawnPenalty, 1, true},
+                {"threatenedByMinorPenalty", &self.threatenedByMinorPenalty, 1, true},
+        };
+    }
+
+    // One "name values..." line; commas work as separators too, so "--eval knightValue=30" style
+    // overrides can be passed through after replacing the '='
+    bool set(const std::string &line) {
+        std::string text = line.substr(0, line.find('#'));
+        for (char &c: text) {
+            if (c == ',' || c == '=') c = ' ';
+        }
+        std::istringstream in(text);
+        std::string name;
+        if (!(in >> name)) return true; // blank or comment
+        for (Field &field: fields()) {
+            if (name != field.name) continue;
+            std::vector<int> values(field.packed ? 2 * field.count : field.count);
+            for (int &value: values) {
+                if (!(in >> value)) {
+                    std::cerr << "Too few values for " << name << std::endl;
+                    return false;
+                }
+            }
+            for (int i = 0; i < field.count; i++) {
+                field.values[i] = field.packed ? makeScore(values[2 * i], values[2 * i + 1]) : values[i];
+            }
+            return true;
+        }
+        std::cerr << "Unknown evaluation parameter " << name << std::endl;
+        return false;
+    }
+
+    bool load(const std::string &path) {
+        std::ifstream in(path);
+        if (!in) {
+            std::cerr << "Could not open " << path << std::endl;
+            return false;
+        }
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!set(line)) return false;
+        }
+        return true;
+    }
+
+    // In the format load() reads
+    void write(std::ostream &out) const {
+        for (const auto &field: fields()) {
+            out << field.name;
+            for (int i = 0; i < field.count; i++) {
+                if (field.packed) {
+                    out << " " << middlegameScore(field.values[i]) << " " << endgameScore(field.values[i]);
+                } else {
+                    out << " " << field.values[i];
+                }
+            }
+            out << "\n";
+        }
+    }
+};
+
+inline constexpr EvalParams defaultEvalParams{};
+
+// The weights tools/texel_tune.cpp tunes, numbered one after another. Tables take one term per entry.
+struct EvalTerms {
+    static const int MATERIAL = 0;                   // pawn..queen
+    static const int PST = MATERIAL + 5;             // [pieceType][square]
+    static const int DOUBLED = PST + 6 * 64;
+    static const int ISOLATED = DOUBLED + 1;
+    static const int BACKWARD = ISOLATED + 1;
+    static const int PASSED = BACKWARD + 1;          // [relativeRank]
+    static const int MOBILITY = PASSED + 8;          // [pieceType]
+    static const int KING_DANGER = MOBILITY + 6;     // [attack weight]
+    static const int HANGING = KING_DANGER + 16;
+    static const int DEFENDED = HANGING + 1;
+    static const int THREATENED_BY_PAWN = DEFENDED + 1;
+    static const int THREATENED_BY_MINOR = THREATENED_BY_PAWN + 1;
+    static const int COUNT = THREATENED_BY_MINOR + 1;
+};
+
+// The evaluation terms report through a trace how many times they added each weight, add(term, count).
+// The search evaluates with this one, which compiles the reports away.
+struct NoEvalTrace {
+    void add(int, int) {}
+};
+
+#endif //UNTITLED7_EVALPARAMS_H
@@ -0,0 +1,190 @@
+#ifndef UNTITLED7_NNUE_H
+#define UNTITLED7_NNUE_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Efficiently updatable evaluation network: 768 piece-square inputs per perspective -> 256 int16
+// accumulators per perspective -> clipped ReLU -> one output.
+//
+// Features are king relative in the simplest way that still pays off: every square is seen from the
+// perspective's own side of the board and mirrored left-right when its king stands on files e-h. A king
+// crossing between the d and e files therefore changes every feature of its perspective, which then gets
+// rebuilt from the bitboards on the next evaluation instead of being updated.
+//
+// Weights file: the 8 byte magic "U7NNUE01", then little-endian
+//   int16 featureWeights[768][256], int16 featureBias[256], int16 outputWeights[512], int32 outputBias
+// where outputWeights holds the side to move's half first. Feature weights and biases are quantised by QA,
+// output weights by QB and the output bias by QA * QB, for a net trained to centipawns.
+class Nnue {
+public:
+    static const int INPUTS = 768;
+    static const int HIDDEN = 256;
+    static const int QA = 255;
+    static const int QB = 64;
+    static const int CENTIPAWNS_PER_UNIT = 10; // the classical eval counts a pawn as 10
+
+    bool load(const std::string &path) {
+        std::ifstream in(path, std::ios::binary);
+        char magic[8];
+        if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, "U7NNUE01", sizeof(magic)) != 0) {
+            return false;
+        }
+        std::vector<int16_t> weights(INPUTS * HIDDEN), bias(HIDDEN), output(2 * HIDDEN);
+        int32_t outBias;
+        if (!readArray(in, weights) || !readArray(in, bias) || !readArray(in, output) ||
+            !in.read(reinterpret_cast<char *>(&outBias), sizeof(outBias))) {
+            return false;
+        }
+        featureWeights = std::move(weights);
+        featureBias = std::move(bias);
+        outputWeights = std::move(output);
+        outputBias = outBias;
+        markDirty();
+        return true;
+    }
+
+    bool loaded() const {
+        return !featureWeights.empty();
+    }
+
+    // Rebuild both accumulators before the next evaluation, after setting up a new position
+    void markDirty() {
+        dirty[0] = dirty[1] = true;
+    }
+
+    // pieceIndex is the zobrist index: white pawn..king 0-5, black pawn..king 6-11
+    void update(int pieceIndex, int square, int sign) {
+        for (int perspective = 0; perspective < 2; perspective++) {
+            if (pieceIndex == kingIndex(perspective) && sign > 0 && mirrorFor(square) != mirrored[perspective]) {
+                mirrored[perspective] = mirrorFor(square);
+                dirty[perspective] = true;
+            }
+            if (dirty[perspective]) continue;
+            const int16_t *column = &featureWeights[featureIndex(perspective, pieceIndex, square) * HIDDEN];
+            if (sign > 0) {
+                addColumn(accumulator[perspective], column);
+            } else {
+                subtractColumn(accumulator[perspective], column);
+            }
+        }
+    }
+
+    // Score for perspective (0 white, 1 black) in the classical eval's units, which has to be the side to
+    // move: its accumulator goes with the first half of outputWeights. bitboards are indexed like
+    // pieceIndex and only read to rebuild an accumulator that went dirty.
+    int evaluate(int perspective, const uint64_t *const bitboards[12]) {
+        for (int side = 0; side < 2; side++) {
+            if (dirty[side]) refresh(side, bitboards);
+        }
+        int64_t sum = static_cast<int64_t>(outputBias) + dot(accumulator[perspective], &outputWeights[0])
+                      + dot(accumulator[1 - perspective], &outputWeights[HIDDEN]);
+        return static_cast<int>(sum / (QA * QB * CENTIPAWNS_PER_UNIT));
+    }
+
+private:
+    std::vector<int16_t> featureWeights;
+    std::vector<int16_t> featureBias;
+    std::vector<int16_t> outputWeights;
+    int32_t outputBias = 0;
+    alignas(32) int16_t accumulator[2][HIDDEN] = {};
+    bool dirty[2] = {true, true};
+    bool mirrored[2] = {false, false};
+
+    static bool readArray(std::ifstream &in, std::vector<int16_t> &values) {
+        return static_cast<bool>(in.read(reinterpret_cast<char *>(values.data()),
+                                         static_cast<std::streamsize>(values.size() * sizeof(int16_t))));
+    }
+
+    static int kingIndex(int perspective) {
+        return perspective == 0 ? 5 : 11;
+    }
+
+    static bool mirrorFor(int kingSquare) {
+        return kingSquare % 8 >= 4;
+    }
+
+    int featureIndex(int perspective, int pieceIndex, int square) const {
+        int pieceType = pieceIndex % 6;
+        int relativeColor = (pieceIndex < 6) == (perspective == 0) ? 0 : 1;
+        if (perspective == 1) square ^= 56; // flip ranks for black
+        if (mirrored[perspective]) square ^= 7; // flip files
+        return (relativeColor * 6 + pieceType) * 64 + square;
+    }
+
+    void refresh(int perspective, const uint64_t *const bitboards[12]) {
+        uint64_t king = *bitboards[kingIndex(perspective)];
+        mirrored[perspective] = king && mirrorFor(__builtin_ctzll(king));
+        std::copy(featureBias.begin(), featureBias.end(), accumulator[perspective]);
+        for (int pieceIndex = 0; pieceIndex < 12; pieceIndex++) {
+            uint64_t pieces = *bitboards[pieceIndex];
+            while (pieces) {
+                int square = __builtin_ctzll(pieces);
+                pieces &= pieces - 1;
+                addColumn(accumulator[perspective], &featureWeights[featureIndex(perspective, pieceIndex, square) * HIDDEN]);
+            }
+        }
+        dirty[perspective] = false;
+    }
+
+#ifdef __AVX2__
+    static void addColumn(int16_t *values, const int16_t *column) {
+        for (int i = 0; i < HIDDEN; i += 16) {
+            __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i *>(values + i));
+            __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(column + i));
+            _mm256_store_si256(reinterpret_cast<__m256i *>(values + i), _mm256_add_epi16(v, w));
+        }
+    }
+
+    static void subtractColumn(int16_t *values, const int16_t *column) {
+        for (int i = 0; i < HIDDEN; i += 16) {
+            __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i *>(values + i));
+            __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(column + i));
+            _mm256_store_si256(reinterpret_cast<__m256i *>(values + i), _mm256_sub_epi16(v, w));
+        }
+    }
+
+    // Clipped ReLU on the accumulator, then the dot product with the output weights. The clipped inputs
+    // are at most QA, so each madd pair stays well inside int32.
+    static int32_t dot(const int16_t *values, const int16_t *weights) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i ceiling = _mm256_set1_epi16(QA);
+        __m256i sum = _mm256_setzero_si256();
+        for (int i = 0; i < HIDDEN; i += 16) {
+            __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i *>(values + i));
+            v = _mm256_min_epi16(_mm256_max_epi16(v, zero), ceiling);
+            __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(weights + i));
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(v, w));
+        }
+        __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+        return _mm_cvtsi128_si32(half);
+    }
+#else
+    static void addColumn(int16_t *values, const int16_t *column) {
+        for (int i = 0; i < HIDDEN; i++) values[i] += column[i];
+    }
+
+    static void subtractColumn(int16_t *values, const int16_t *column) {
+        for (int i = 0; i < HIDDEN; i++) values[i] -= column[i];
+    }
+
+    static int32_t dot(const int16_t *values, const int16_t *weights) {
+        int32_t sum = 0;
+        for (int i = 0; i < HIDDEN; i++) {
+            sum += std::min<int32_t>(std::max<int32_t>(values[i], 0), QA) * weights[i];
+        }
+        return sum;
+    }
+#endif
+};
+
+#endif //UNTITLED7_NNUE_H
@@ -0,0 +1,211 @@
+#ifndef UNTITLED7_PROFILER_H
+#define UNTITLED7_PROFILER_H
+
+// Scoped timers for the phases of the search, built only with PROFILE_SEARCH defined. Without it
+// PROFILE_SCOPE expands to nothing and this header declares nothing else.
+//
+// Each thread keeps a tree of the phases it entered (search -> generate -> legality ...) with the cycles
+// and calls spent in each, read from the time stamp counter. A phase entered again inside itself, like the
+// recursive quiescence search, is counted once, so the tree stays as deep as the phases nest and not as
+// deep as the search. SearchProfiler::writeFolded and writeChromeTrace export the trees of all threads.
+#ifdef PROFILE_SEARCH
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+class SearchProfiler {
+public:
+    enum Phase {
+        Search, Quiesce, Generate, Legality, Evaluate, Make, Unmake, PhaseCount
+    };
+
+    static const char *phaseName(int phase) {
+        static const char *const names[PhaseCount] = {"search", "quiesce", "generate", "legality", "evaluate",
+                                                      "make", "unmake"};
+        return names[phase];
+    }
+
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+
+    struct Node {
+        int phase;
+        int parent;
+        int children[PhaseCount];
+        uint64_t cycles = 0; // including the children
+        uint64_t calls = 0;
+
+        Node(int phase, int parent) : phase(phase), parent(parent) {
+            std::fill(std::begin(children), std::end(children), -1);
+        }
+    };
+
+    // The phase tree of one thread, node 0 is the root outside every phase
+    struct ThreadProfile {
+        std::vector<Node> nodes{Node(-1, -1)};
+        int current = 0;
+
+        // Returns false for a phase entered inside itself, which is left alone
+        bool enter(int phase) {
+            if (nodes[current].phase == phase) return false;
+            int child = nodes[current].children[phase];
+            if (child < 0) {
+                child = static_cast<int>(nodes.size());
+                nodes.emplace_back(phase, current);
+                nodes[current].children[phase] = child;
+            }
+            current = child;
+            return true;
+        }
+
+        void leave(uint64_t cycles) {
+            nodes[current].cycles += cycles;
+            nodes[current].calls++;
+            current = nodes[current].parent;
+        }
+    };
+
+    static ThreadProfile &threadProfile() {
+        thread_local ThreadProfile *profile = nullptr;
+        if (!profile) {
+            std::lock_guard<std::mutex> lock(registryMutex());
+            registry().push_back(std::make_unique<ThreadProfile>());
+            profile = registry().back().get();
+        }
+        return *profile;
+    }
+
+    // Forgets the phases timed so far, only while no other thread is inside a timed phase
+    static void reset() {
+        std::lock_guard<std::mutex> lock(registryMutex());
+        for (auto &profile: registry()) {
+            profile->nodes.assign(1, Node(-1, -1));
+            profile->current = 0;
+        }
+    }
+
+    // Folded stacks, "search;generate;legality <microseconds>" per line with the time spent in that phase
+    // itself, the input of flamegraph.pl and speedscope
+    static void writeFolded(std::ostream &out) {
+        std::lock_guard<std::mutex> lock(registryMutex());
+        double microsecondsPerCycle = 1e6 / cyclesPerSecond();
+        for (size_t thread = 0; thread < registry().size(); thread++) {
+            const ThreadProfile &profile = *registry()[thread];
+            for (size_t i = 1; i < profile.nodes.size(); i++) {
+                uint64_t self = selfCycles(profile, static_cast<int>(i));
+                if (self == 0) continue;
+                std::string stack;
+                for (int node = static_cast<int>(i); node > 0; node = profile.nodes[node].parent) {
+                    stack = std::string(phaseName(profile.nodes[node].phase)) + (stack.empty() ? "" : ";") + stack;
+                }
+                if (registry().size() > 1) stack = "thread " + std::to_string(thread) + ";" + stack;
+                out << stack << " " << static_cast<long long>(self * microsecondsPerCycle + 0.5) << "\n";
+            }
+        }
+    }
+
+    // Chrome trace-event JSON (chrome://tracing, Perfetto). The totals are laid out as one complete event
+    // per tree node, children packed from their parent's start, so the timeline reads like a flame graph
+    // and each event carries its call count.
+    static void writeChromeTrace(std::ostream &out) {
+        std::lock_guard<std::mutex> lock(registryMutex());
+        double microsecondsPerCycle = 1e6 / cyclesPerSecond();
+        out << "{\"traceEvents\":[";
+        bool first = true;
+        for (size_t thread = 0; thread < registry().size(); thread++) {
+            const ThreadProfile &profile = *registry()[thread];
+            writeEvents(out, profile, 0, 0.0, static_cast<int>(thread), microsecondsPerCycle, first);
+        }
+        out << "],\"displayTimeUnit\":\"ms\"}\n";
+    }
+
+private:
+    static std::vector<std::unique_ptr<ThreadProfile>> &registry() {
+        static std::vector<std::unique_ptr<ThreadProfile>> profiles;
+        return profiles;
+    }
+
+    static std::mutex &registryMutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    // Time stamp counter ticks per second, measured once against the steady clock
+    static double cyclesPerSecond() {
+        static const double rate = [] {
+            auto start = std::chrono::steady_clock::now();
+            uint64_t startCycles = now();
+            while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(20)) {}
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return static_cast<double>(now() - startCycles) / seconds;
+        }();
+        return rate;
+    }
+
+    static uint64_t selfCycles(const ThreadProfile &profile, int index) {
+        const Node &node = profile.nodes[index];
+        uint64_t children = 0;
+        for (int child: node.children) {
+            if (child >= 0) children += profile.nodes[child].cycles;
+        }
+        return node.cycles > children ? node.cycles - children : 0;
+    }
+
+    static void writeEvents(std::ostream &out, const ThreadProfile &profile, int index, double start, int thread,
+                            double microsecondsPerCycle, bool &first) {
+        const Node &node = profile.nodes[index];
+        if (index > 0) {
+            out << (first ? "" : ",") << "\n{\"name\":\"" << phaseName(node.phase) << "\",\"ph\":\"X\",\"pid\":0,\"tid\":"
+                << thread << ",\"ts\":" << start << ",\"dur\":" << node.cycles * microsecondsPerCycle
+                << ",\"args\":{\"calls\":" << node.calls << "}}";
+            first = false;
+        }
+        for (int child: node.children) {
+            if (child < 0) continue;
+            writeEvents(out, profile, child, start, thread, microsecondsPerCycle, first);
+            start += profile.nodes[child].cycles * microsecondsPerCycle;
+        }
+    }
+};
+
+class ScopedTimer {
+public:
+    explicit ScopedTimer(SearchProfiler::Phase phase)
+            : profile(SearchProfiler::threadProfile()), active(profile.enter(phase)), start(SearchProfiler::now()) {}
+
+    ~ScopedTimer() {
+        if (active) profile.leave(SearchProfiler::now() - start);
+    }
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+    SearchProfiler::ThreadProfile &profile;
+    bool active;
+    uint64_t start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(phase) ScopedTimer PROFILE_CONCAT(profileTimer, __LINE__)(SearchProfiler::phase)
+
+#else
+#define PROFILE_SCOPE(phase)
+#endif
+
+#endif //UNTITLED7_PROFILER_H
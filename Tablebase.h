@@ -0,0 +1,292 @@
+#ifndef UNTITLED7_TABLEBASE_H
+#define UNTITLED7_TABLEBASE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Endgame tables with the distance to mate of every position with up to 4 pieces, made by tools/tb_gen.cpp.
+// There is one file per material, named after it with white's pieces first ("KQvKR.tb"). Positions with
+// the colours the other way round are looked up in the same file with the board flipped.
+//
+// Piece kinds are ChessBoard's zobrist index order: white pawn, knight, bishop, rook, queen, king, then
+// the black pieces the same way.
+struct TbMaterial {
+    static const int MAX_PIECES = 4;
+    int count = 0;
+    int kinds[MAX_PIECES] = {}; // white king, black king, white's other pieces, black's, strongest first
+
+    // Sorts kinds, one piece each, into index order. False unless there is exactly one king per side.
+    bool set(const int *pieceKinds, int pieceCount) {
+        if (pieceCount < 2 || pieceCount > MAX_PIECES) return false;
+        std::vector<int> white, black;
+        int whiteKings = 0, blackKings = 0;
+        for (int i = 0; i < pieceCount; i++) {
+            int kind = pieceKinds[i];
+            if (kind == 5) whiteKings++;
+            else if (kind == 11) blackKings++;
+            else if (kind >= 0 && kind < 5) white.push_back(kind);
+            else if (kind > 5 && kind < 11) black.push_back(kind);
+            else return false;
+        }
+        if (whiteKings != 1 || blackKings != 1) return false;
+        std::sort(white.begin(), white.end(), std::greater<int>());
+        std::sort(black.begin(), black.end(), std::greater<int>());
+        count = 0;
+        kinds[count++] = 5;
+        kinds[count++] = 11;
+        for (int kind: white) kinds[count++] = kind;
+        for (int kind: black) kinds[count++] = kind;
+        return true;
+    }
+
+    // "KQvKR", the pieces after each king in any order
+    bool parse(const std::string &name) {
+        size_t versus = name.find('v');
+        if (versus == std::string::npos || name[0] != 'K' || versus + 1 >= name.size() || name[versus + 1] != 'K') {
+            return false;
+        }
+        int pieceKinds[MAX_PIECES], pieceCount = 0;
+        for (size_t i = 0; i < name.size(); i++) {
+            if (i == versus) continue;
+            size_t kind = std::string("PNBRQK").find(name[i]);
+            if (kind == std::string::npos || pieceCount == MAX_PIECES) return false;
+            pieceKinds[pieceCount++] = static_cast<int>(kind) + (i > versus ? 6 : 0);
+        }
+        return set(pieceKinds, pieceCount);
+    }
+
+    std::string name() const {
+        std::string text = "K";
+        for (int i = 2; i < count; i++) {
+            if (kinds[i] > 5 && (i == 2 || kinds[i - 1] < 6)) text += "vK";
+            text += "PNBRQK"[kinds[i] % 6];
+        }
+        if (count == 2 || kinds[count - 1] < 6) text += "vK";
+        return text;
+    }
+
+    // The same endgame with the colours swapped
+    TbMaterial flipped() const {
+        int pieceKinds[MAX_PIECES];
+        for (int i = 0; i < count; i++) pieceKinds[i] = (kinds[i] + 6) % 12;
+        TbMaterial material;
+        material.set(pieceKinds, count);
+        return material;
+    }
+
+    // Number of pieces of each kind, 4 bits per kind
+    static uint64_t key(const int *pieceKinds, int pieceCount) {
+        uint64_t key = 0;
+        for (int i = 0; i < pieceCount; i++) key += 1ULL << (4 * pieceKinds[i]);
+        return key;
+    }
+
+    uint64_t key() const {
+        return key(kinds, count);
+    }
+
+    // Side to move, the white king on files a-d (the board is mirrored when it isn't) and every other
+    // piece on any square
+    size_t size() const {
+        return static_cast<size_t>(2 * 32) << (6 * (count - 1));
+    }
+
+    // squares in the order of kinds
+    size_t index(const int *squares, bool whiteToMove) const {
+        int mirror = (squares[0] & 7) > 3 ? 7 : 0;
+        size_t index = whiteToMove ? 0 : 1;
+        index = index * 32 + (squares[0] >> 3) * 4 + ((squares[0] ^ mirror) & 7);
+        for (int i = 1; i < count; i++) index = index * 64 + (squares[i] ^ mirror);
+        return index;
+    }
+
+    // index backwards, the white king always comes out on files a-d
+    void squaresOf(size_t index, int *squares, bool &whiteToMove) const {
+        for (int i = count - 1; i > 0; i--) {
+            squares[i] = static_cast<int>(index % 64);
+            index /= 64;
+        }
+        squares[0] = static_cast<int>(index % 32 / 4 * 8 + index % 4);
+        whiteToMove = index / 32 == 0;
+    }
+};
+
+// The files: a 16 byte header ("U7TBDTM1", piece count, padding), then one byte per TbMaterial index, so
+// a probe is an index computation and one read from the mapped file. A byte is DRAW, INVALID for
+// positions that can't occur (the side not to move in check, two pieces on a square, pawns on the back
+// ranks) or 1 + the plies to mate with best play: odd when the side to move mates, even when it gets
+// mated. Castling and en passant are not in the tables.
+class Tablebases {
+public:
+    static constexpr uint8_t DRAW = 0, INVALID = 255;
+    static constexpr int MAX_PLIES = 252;
+
+    static uint8_t valueFor(int plies) {
+        return static_cast<uint8_t>(plies + 1);
+    }
+
+    static int plies(uint8_t value) {
+        return value - 1;
+    }
+
+    static bool isWin(uint8_t value) {
+        return value != DRAW && value != INVALID && plies(value) % 2 == 1;
+    }
+
+    // Every .tb file in directory, returns how many could be opened
+    int load(const std::string &directory) {
+        int loaded = 0;
+        std::error_code error;
+        for (const auto &file: std::filesystem::directory_iterator(directory, error)) {
+            if (file.path().extension() == ".tb" && open(file.path().string())) loaded++;
+        }
+        return loaded;
+    }
+
+    bool open(const std::string &path) {
+        TbMaterial material;
+        if (!material.parse(std::filesystem::path(path).stem().string())) return false;
+        auto table = std::make_unique<Table>();
+        if (!table->map(path) || table->size != HEADER_SIZE + material.size() ||
+            std::memcmp(table->data, MAGIC, 8) != 0 || table->data[8] != material.count) {
+            return false;
+        }
+        table->material = material;
+        maxCount = std::max(maxCount, material.count);
+        tables[material.key()] = std::move(table);
+        return true;
+    }
+
+    // Largest number of pieces of a loaded table, 0 without tables
+    int maxPieces() const {
+        return maxCount;
+    }
+
+    // Whether material can be probed, in either colour
+    bool has(const TbMaterial &material) const {
+        return material.count == 2 || tables.count(material.key()) || tables.count(material.flipped().key());
+    }
+
+    // The value for the side to move of a position given by the kinds and squares of all its pieces, in
+    // any order. False when there is no table for its material.
+    bool probe(const int *kinds, const int *squares, int count, bool whiteToMove, uint8_t &value) const {
+        if (count == 2) {
+            value = DRAW; // bare kings
+            return true;
+        }
+        if (count > maxCount) return false;
+        bool flip = false;
+        auto found = tables.find(TbMaterial::key(kinds, count));
+        if (found == tables.end()) {
+            int flippedKinds[TbMaterial::MAX_PIECES];
+            for (int i = 0; i < count; i++) flippedKinds[i] = (kinds[i] + 6) % 12;
+            found = tables.find(TbMaterial::key(flippedKinds, count));
+            flip = true;
+        }
+        if (found == tables.end()) return false;
+
+        const TbMaterial &material = found->second->material;
+        int ordered[TbMaterial::MAX_PIECES];
+        bool used[TbMaterial::MAX_PIECES] = {};
+        for (int slot = 0; slot < count; slot++) {
+            int wanted = flip ? (material.kinds[slot] + 6) % 12 : material.kinds[slot];
+            for (int i = 0; i < count; i++) {
+                if (!used[i] && kinds[i] == wanted) {
+                    used[i] = true;
+                    ordered[slot] = flip ? squares[i] ^ 56 : squares[i];
+                    break;
+                }
+            }
+        }
+        value = found->second->data[HEADER_SIZE + material.index(ordered, whiteToMove != flip)];
+        return value != INVALID;
+    }
+
+    // Same with the position as bitboards in zobrist index order
+    bool probe(const uint64_t *const bitboards[12], bool whiteToMove, uint8_t &value) const {
+        int kinds[TbMaterial::MAX_PIECES], squares[TbMaterial::MAX_PIECES], count = 0;
+        for (int kind = 0; kind < 12; kind++) {
+            uint64_t pieces = *bitboards[kind];
+            while (pieces) {
+                if (count == TbMaterial::MAX_PIECES) return false;
+                kinds[count] = kind;
+                squares[count++] = __builtin_ctzll(pieces);
+                pieces &= pieces - 1;
+            }
+        }
+        return probe(kinds, squares, count, whiteToMove, value);
+    }
+
+    // values has material.size() entries
+    static bool write(const std::string &path, const TbMaterial &material, const std::vector<uint8_t> &values) {
+        std::ofstream out(path, std::ios::binary);
+        char header[HEADER_SIZE] = {};
+        std::memcpy(header, MAGIC, 8);
+        header[8] = static_cast<char>(material.count);
+        out.write(header, HEADER_SIZE);
+        out.write(reinterpret_cast<const char *>(values.data()), static_cast<std::streamsize>(values.size()));
+        return static_cast<bool>(out);
+    }
+
+private:
+    static constexpr size_t HEADER_SIZE = 16;
+    static constexpr const char *MAGIC = "U7TBDTM1";
+
+    struct Table {
+        TbMaterial material;
+        const unsigned char *data = nullptr;
+        size_t size = 0;
+        bool mapped = false;
+#ifdef _WIN32
+        std::vector<char> copy;
+#endif
+
+        ~Table() {
+#ifndef _WIN32
+            if (mapped) munmap(const_cast<unsigned char *>(data), size);
+#endif
+        }
+
+        bool map(const std::string &path) {
+#ifndef _WIN32
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) return false;
+            struct stat info{};
+            if (fstat(fd, &info) == 0 && info.st_size > 0) {
+                void *mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapping != MAP_FAILED) {
+                    data = static_cast<const unsigned char *>(mapping);
+                    size = static_cast<size_t>(info.st_size);
+                    mapped = true;
+                }
+            }
+            ::close(fd);
+#else
+            // No mmap here, keep a copy instead
+            std::ifstream in(path, std::ios::binary);
+            copy.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            data = reinterpret_cast<const unsigned char *>(copy.data());
+            size = copy.size();
+#endif
+            return size > 0;
+        }
+    };
+
+    std::map<uint64_t, std::unique_ptr<Table>> tables;
+    int maxCount = 0;
+};
+
+#endif //UNTITLED7_TABLEBASE_H
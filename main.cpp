@@ -5,8 +5,29 @@
 #include "generateBoard.cpp"
 
 
-int main() {
+int main(int argc, char *argv[]) {
     ChessBoard board;
+    // --nnue <file> evaluates with a network instead of the handwritten terms,
+    // --eval-params <file> and --eval <name>=<values> replace handwritten weights (see EvalParams.h),
+    // --book <file> plays the opening from a Polyglot book (see Book.h),
+    // --tb <directory> plays endgames of up to 4 pieces from the tables tbgen made there (see Tablebase.h),
+    // --eval-cache <entries> sizes the evaluation cache, rounded down to a power of two, 0 turns it off
+    for (int i = 1; i + 1 < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--nnue") {
+            board.loadNnue(argv[++i]);
+        } else if (option == "--eval-params") {
+            board.loadEvalParams(argv[++i]);
+        } else if (option == "--eval") {
+            board.setEvalParam(argv[++i]);
+        } else if (option == "--book") {
+            board.loadBook(argv[++i]);
+        } else if (option == "--tb") {
+            board.loadTablebases(argv[++i]);
+        } else if (option == "--eval-cache") {
+            board.evalCache.resize(std::strtoull(argv[++i], nullptr, 10));
+        }
+    }
     generateBoard bräda(&board);
     board.printBoard(); // Print initial board setup
     bräda.run(&board);
@@ -0,0 +1,81 @@
+// Throughput of BatchEvaluator in positions per second.
+//   batchbench [fen file] [repeat]
+// Without a FEN file the positions come from random games from the start position.
+#include <chrono>
+#include <fstream>
+#include <random>
+#include "../BatchEval.h"
+
+static void addRandomGames(PositionBatch &batch, int games) {
+    std::mt19937 rng(12345);
+    ChessBoard board;
+    for (int game = 0; game < games; game++) {
+        board.loadFen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+        bool white = true;
+        for (int ply = 0; ply < 120; ply++) {
+            std::vector<Move> moves = board.generateMovesForColoren(white);
+            std::shuffle(moves.begin(), moves.end(), rng);
+            bool moved = false;
+            for (const Move &move: moves) {
+                board.movePiece(move);
+                if (!board.isKingInCheck(white)) {
+                    moved = true;
+                    break;
+                }
+                board.resetPreviousMove();
+            }
+            if (!moved) break;
+            white = !white;
+            batch.add(board);
+        }
+    }
+}
+
+template<typename F>
+static double positionsPerSecond(size_t positions, int repeat, F evaluate) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeat; i++) evaluate();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return positions * static_cast<double>(repeat) / seconds;
+}
+
+int main(int argc, char *argv[]) {
+    PositionBatch batch;
+    if (argc > 1) {
+        std::ifstream in(argv[1]);
+        ChessBoard board;
+        std::string fen;
+        while (std::getline(in, fen)) {
+            if (board.loadFen(fen)) batch.add(board);
+        }
+    } else {
+        addRandomGames(batch, 2000);
+    }
+    int repeat = argc > 2 ? std::atoi(argv[2]) : 20;
+    if (batch.size() == 0) {
+        std::cerr << "No positions" << std::endl;
+        return 1;
+    }
+
+    BatchEvaluator evaluator;
+    std::vector<int> scores(batch.size()), plainScores(batch.size());
+    long long checksum = 0;
+    double batched = positionsPerSecond(batch.size(), repeat, [&] {
+        evaluator.evaluate(batch, scores.data());
+        checksum += scores[0];
+    });
+    double plain = positionsPerSecond(batch.size(), repeat, [&] {
+        for (size_t i = 0; i < batch.size(); i++) plainScores[i] = evaluator.evaluateOne(batch, i);
+        checksum += plainScores[0];
+    });
+
+    std::cout << batch.size() << " positions x " << repeat << std::endl;
+#ifdef __AVX2__
+    std::cout << "batch (AVX2): " << static_cast<long long>(batched) << " positions/s" << std::endl;
+#else
+    std::cout << "batch (scalar build): " << static_cast<long long>(batched) << " positions/s" << std::endl;
+#endif
+    std::cout << "one at a time: " << static_cast<long long>(plain) << " positions/s" << std::endl;
+    std::cout << "results " << (scores == plainScores ? "match" : "DIFFER") << " (checksum " << checksum << ")" << std::endl;
+    return scores == plainScores ? 0 : 1;
+}
@@ -0,0 +1,280 @@
+// Builds a Polyglot opening book from PGN games.
+//   bookbuilder <pgn file> [--out book.bin] [--plies n] [--min-games n] [--threads n]
+// The PGN is streamed in batches of games to worker threads, so its size doesn't matter, only the number
+// of distinct position/move pairs in the first --plies plies (default 24) is held in memory. Every move
+// scores 2 for a win, 1 for a draw and 0 for a loss of the side that played it; the weight in the book is
+// that total, scaled down per position when it doesn't fit 16 bits. Moves played in fewer than
+// --min-games games (default 2), or that never scored, are left out. Positions are keyed with the
+// standard Polyglot Random64 table (see Book.h), so other programs can read the book.
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "../ChessBoard.cpp"
+
+static const char *const startPosition = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+struct BookKey {
+    uint64_t key;
+    uint16_t move;
+
+    bool operator==(const BookKey &other) const {
+        return key == other.key && move == other.move;
+    }
+};
+
+struct BookKeyHash {
+    size_t operator()(const BookKey &entry) const {
+        return static_cast<size_t>(entry.key ^ (static_cast<uint64_t>(entry.move) * 0x9E3779B97F4A7C15ULL));
+    }
+};
+
+struct MoveStats {
+    uint32_t games = 0;
+    uint32_t score = 0; // 2 per win and 1 per draw for the side making the move
+};
+
+using BookStats = std::unordered_map<BookKey, MoveStats, BookKeyHash>;
+
+// Batches of raw game texts from the reader to the workers, bounded so a fast reader can't fill memory
+class GameQueue {
+public:
+    explicit GameQueue(size_t capacity) : capacity(capacity) {}
+
+    void push(std::vector<std::string> batch) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [&] { return batches.size() < capacity; });
+        batches.push_back(std::move(batch));
+        notEmpty.notify_one();
+    }
+
+    // False once the reader is done and everything has been handed out
+    bool pop(std::vector<std::string> &batch) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [&] { return !batches.empty() || finished; });
+        if (batches.empty()) return false;
+        batch = std::move(batches.front());
+        batches.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    void finish() {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+        notEmpty.notify_all();
+    }
+
+private:
+    size_t capacity;
+    std::deque<std::vector<std::string>> batches;
+    bool finished = false;
+    std::mutex mutex;
+    std::condition_variable notFull, notEmpty;
+};
+
+// Movetext without comments, variations, NAGs and move numbers, one SAN move per entry
+static std::vector<std::string> sanMoves(const std::string &movetext) {
+    std::vector<std::string> moves;
+    std::string token;
+    int variationDepth = 0;
+    bool braceComment = false, lineComment = false;
+    auto finishToken = [&] {
+        if (!token.empty() && variationDepth == 0) {
+            size_t dots = token.find_last_of('.');
+            if (dots != std::string::npos) token.erase(0, dots + 1); // "12.e4" and "12..." alike
+            bool result = token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*";
+            if (!token.empty() && token[0] != '$' && !result) moves.push_back(token);
+        }
+        token.clear();
+    };
+    for (char c: movetext) {
+        if (lineComment) {
+            lineComment = c != '\n';
+        } else if (braceComment) {
+            braceComment = c != '}';
+        } else if (c == '{') {
+            finishToken();
+            braceComment = true;
+        } else if (c == ';') {
+            finishToken();
+            lineComment = true;
+        } else if (c == '(') {
+            finishToken();
+            variationDepth++;
+        } else if (c == ')') {
+            finishToken();
+            variationDepth = std::max(0, variationDepth - 1);
+        } else if (std::isspace(static_cast<unsigned char>(c))) {
+            finishToken();
+        } else {
+            token += c;
+        }
+    }
+    finishToken();
+    return moves;
+}
+
+// Value of a [Tag "value"] line, empty when the line is another tag
+static std::string tagValue(const std::string &line, const std::string &tag) {
+    if (line.compare(0, tag.size() + 2, "[" + tag + " ") != 0) return "";
+    size_t open = line.find('"'), close = line.rfind('"');
+    return open != std::string::npos && close > open ? line.substr(open + 1, close - open - 1) : "";
+}
+
+// Adds the first plies of one game to stats, false when it was skipped. Games without a decided result
+// ("*" or no Result tag) have nothing to score and are skipped; a move that doesn't parse ends the game
+// there.
+static bool addGame(ChessBoard &board, const std::string &game, int plies, BookStats &stats) {
+    std::string fen = startPosition, result, movetext, line;
+    std::istringstream lines(game);
+    while (std::getline(lines, line)) {
+        if (!line.empty() && line[0] == '[') {
+            std::string value = tagValue(line, "FEN");
+            if (!value.empty()) fen = value;
+            value = tagValue(line, "Result");
+            if (!value.empty()) result = value;
+        } else {
+            movetext += line;
+            movetext += '\n';
+        }
+    }
+    int whiteScore = result == "1-0" ? 2 : result == "0-1" ? 0 : result == "1/2-1/2" ? 1 : -1;
+    if (whiteScore < 0 || !board.loadFen(fen)) return false;
+
+    std::vector<std::string> moves = sanMoves(movetext);
+    for (int ply = 0; ply < plies && ply < static_cast<int>(moves.size()); ply++) {
+        bool white = board.whitesTurn;
+        Move move;
+        if (!board.parseMove(moves[ply], white, move)) break;
+        std::string uci = board.moveToUci(move);
+        if (move.castle) uci[2] = ChessBoard::bitScanForward(move.kingToSquare) % 8 == 6 ? 'h' : 'a'; // king takes rook
+        MoveStats &entry = stats[{board.polyglotKey(white), PolyglotBook::moveCode(uci)}];
+        entry.games++;
+        entry.score += static_cast<uint32_t>(white ? whiteScore : 2 - whiteScore);
+        board.movePiece(move);
+        board.whitesTurn = !white;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: bookbuilder <pgn file> [--out book.bin] [--plies n] [--min-games n] [--threads n]"
+                  << std::endl;
+        return 1;
+    }
+    std::string outPath = "book.bin";
+    int plies = 24;
+    uint32_t minGames = 2;
+    int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        if (option == "--out") outPath = argv[i + 1];
+        else if (option == "--plies") plies = std::atoi(argv[i + 1]);
+        else if (option == "--min-games") minGames = static_cast<uint32_t>(std::atoi(argv[i + 1]));
+        else if (option == "--threads") threads = std::max(1, std::atoi(argv[i + 1]));
+    }
+    std::ifstream in(argv[1]);
+    if (!in) {
+        std::cerr << "Can't read " << argv[1] << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    GameQueue queue(4 * static_cast<size_t>(threads));
+    std::vector<BookStats> threadStats(threads);
+    std::vector<long long> threadGames(threads, 0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            auto board = std::make_unique<ChessBoard>();
+            std::vector<std::string> batch;
+            while (queue.pop(batch)) {
+                for (const std::string &game: batch) {
+                    if (addGame(*board, game, plies, threadStats[t])) threadGames[t]++;
+                }
+            }
+        });
+    }
+
+    // A game is its tag section plus movetext; the next tag line after movetext starts another one
+    std::vector<std::string> batch;
+    std::string game, line;
+    bool inMovetext = false;
+    long long bytes = 0;
+    while (std::getline(in, line)) {
+        bytes += static_cast<long long>(line.size()) + 1;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty() && line[0] == '[' && inMovetext) {
+            batch.push_back(std::move(game));
+            game.clear();
+            inMovetext = false;
+            if (batch.size() == 256) {
+                queue.push(std::move(batch));
+                batch.clear();
+            }
+        }
+        if (!line.empty() && line[0] != '[') inMovetext = true;
+        game += line;
+        game += '\n';
+    }
+    if (inMovetext) batch.push_back(std::move(game));
+    if (!batch.empty()) queue.push(std::move(batch));
+    queue.finish();
+    for (auto &worker: workers) worker.join();
+
+    BookStats stats = std::move(threadStats[0]);
+    for (int t = 1; t < threads; t++) {
+        for (const auto &[key, moveStats]: threadStats[t]) {
+            MoveStats &entry = stats[key];
+            entry.games += moveStats.games;
+            entry.score += moveStats.score;
+        }
+        BookStats().swap(threadStats[t]);
+    }
+    long long games = 0;
+    for (long long count: threadGames) games += count;
+
+    struct BookEntry {
+        uint64_t key;
+        uint16_t move;
+        uint32_t score;
+    };
+    std::vector<BookEntry> entries;
+    for (const auto &[key, moveStats]: stats) {
+        if (moveStats.games >= minGames && moveStats.score > 0) entries.push_back({key.key, key.move, moveStats.score});
+    }
+    BookStats().swap(stats);
+    std::sort(entries.begin(), entries.end(), [](const BookEntry &a, const BookEntry &b) {
+        return a.key != b.key ? a.key < b.key : a.score > b.score;
+    });
+
+    std::ofstream out(outPath, std::ios::binary);
+    size_t positions = 0;
+    for (size_t first = 0; first < entries.size();) {
+        size_t last = first;
+        while (last < entries.size() && entries[last].key == entries[first].key) last++;
+        // Sorted by score, the first move of a position has the largest
+        double scale = std::min(1.0, 65535.0 / entries[first].score);
+        for (size_t i = first; i < last; i++) {
+            auto weight = static_cast<uint16_t>(std::max(1.0, entries[i].score * scale));
+            PolyglotBook::writeEntry(out, entries[i].key, entries[i].move, weight);
+        }
+        positions++;
+        first = last;
+    }
+    out.close();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << games << " games, " << bytes / 1048576.0 << " MB in " << seconds << " s ("
+              << static_cast<long long>(games / std::max(seconds, 1e-9)) << " games/s, " << threads << " threads)"
+              << std::endl;
+    std::cout << entries.size() << " moves in " << positions << " positions written to " << outPath << std::endl;
+    return 0;
+}
@@ -0,0 +1,225 @@
+// Runs an EPD test suite (WAC, STS, ...) and counts the positions solved.
+//   epdsuite <epd file> [--time seconds] [--nodes n] [--depth d] [--threads n] [--tb directory]
+// A position is solved when the search ends on one of its bm moves, or on none of its am moves. Every
+// thread searches its own positions on its own ChessBoard, only the read-only endgame tables of --tb are
+// shared, so the suite scales with the cores. The limits apply per position; the default is 1 second.
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "../ChessBoard.cpp"
+
+struct EpdPosition {
+    std::string fen;
+    std::string id;
+    std::vector<std::string> bestMoves;  // bm, in SAN
+    std::vector<std::string> avoidMoves; // am
+};
+
+struct EpdResult {
+    bool searched = false;
+    bool solved = false;
+    std::string move;
+    double seconds = 0;
+    double solvedAfter = -1; // time at which the search settled on a solution for good, -1 if it never did
+    long long nodes = 0;
+};
+
+// "<placement> <side> <castling> <ep> op arg...; op arg...;" with quoted arguments for id and comments
+static bool parseEpd(const std::string &line, EpdPosition &position) {
+    std::istringstream stream(line);
+    std::string fields[4];
+    for (auto &field: fields) {
+        if (!(stream >> field)) return false;
+    }
+    position.fen = fields[0] + " " + fields[1] + " " + fields[2] + " " + fields[3];
+    std::string rest;
+    std::getline(stream, rest);
+
+    std::vector<std::string> operation;
+    std::string token;
+    bool quoted = false;
+    auto finishToken = [&] {
+        if (!token.empty()) operation.push_back(token);
+        token.clear();
+    };
+    auto finishOperation = [&] {
+        finishToken();
+        if (operation.empty()) return;
+        const std::string &opcode = operation[0];
+        std::vector<std::string> arguments(operation.begin() + 1, operation.end());
+        if (opcode == "bm") position.bestMoves = arguments;
+        if (opcode == "am") position.avoidMoves = arguments;
+        if (opcode == "id" && !arguments.empty()) position.id = arguments[0];
+        operation.clear();
+    };
+    for (char c: rest) {
+        if (c == '"') {
+            quoted = !quoted;
+        } else if (quoted) {
+            token += c;
+        } else if (c == ';') {
+            finishOperation();
+        } else if (std::isspace(static_cast<unsigned char>(c))) {
+            finishToken();
+        } else {
+            token += c;
+        }
+    }
+    finishOperation();
+    return !position.bestMoves.empty() || !position.avoidMoves.empty();
+}
+
+// Whether move is a solution, with the bm/am moves resolved on the same board
+static bool isSolution(ChessBoard &board, const EpdPosition &position, const Move &move) {
+    auto matches = [&](const std::vector<std::string> &moves) {
+        for (const std::string &text: moves) {
+            Move listed;
+            if (board.parseMove(text, board.whitesTurn, listed) && listed.sameAs(move)) return true;
+        }
+        return false;
+    };
+    if (!position.bestMoves.empty() && !matches(position.bestMoves)) return false;
+    return !matches(position.avoidMoves);
+}
+
+static EpdResult solve(ChessBoard &board, const EpdPosition &position, const ChessBoard::SearchLimits &limits,
+                       int maxDepth) {
+    EpdResult result;
+    if (!board.loadFen(position.fen)) return result;
+    board.clearHashTables();
+    result.searched = true;
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&] {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+    Move best;
+    // One iteration per call, to see when the best move turned into a solution. The TT carries the
+    // ordering from one call to the next like inside searchBestMove.
+    for (int depth = 1; depth <= maxDepth; depth++) {
+        board.searchLimits = limits;
+        if (limits.seconds > 0) {
+            board.searchLimits.seconds = limits.seconds - elapsed();
+            if (board.searchLimits.seconds <= 0) break;
+        }
+        if (limits.nodes > 0) {
+            board.searchLimits.nodes = limits.nodes - result.nodes;
+            if (board.searchLimits.nodes <= 0) break;
+        }
+        Move move = board.searchBestMove(board.whitesTurn, depth, depth);
+        result.nodes += board.searchedNodes;
+        if (board.searchAborted) {
+            if (!best.pieceMoved && move.pieceMoved) best = move;
+            break;
+        }
+        if (!move.pieceMoved) break; // no legal move
+        best = move;
+        bool solvedNow = isSolution(board, position, best);
+        if (solvedNow && result.solvedAfter < 0) result.solvedAfter = elapsed();
+        if (!solvedNow) result.solvedAfter = -1;
+        if (std::abs(best.score) >= ChessBoard::MATE_BOUND) break;
+    }
+    result.seconds = elapsed();
+    if (best.pieceMoved) {
+        result.move = board.moveToSan(best);
+        result.solved = isSolution(board, position, best);
+    }
+    if (!result.solved) result.solvedAfter = -1;
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: epdsuite <epd file> [--time seconds] [--nodes n] [--depth d] [--threads n] [--tb directory]"
+                  << std::endl;
+        return 1;
+    }
+    ChessBoard::SearchLimits limits;
+    int maxDepth = 64;
+    bool depthGiven = false;
+    int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    std::shared_ptr<const Tablebases> tablebases;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        if (option == "--time") {
+            limits.seconds = std::atof(argv[i + 1]);
+        } else if (option == "--nodes") {
+            limits.nodes = std::atoll(argv[i + 1]);
+        } else if (option == "--depth") {
+            maxDepth = std::atoi(argv[i + 1]);
+            depthGiven = true;
+        } else if (option == "--threads") {
+            threads = std::max(1, std::atoi(argv[i + 1]));
+        } else if (option == "--tb") {
+            auto tables = std::make_shared<Tablebases>();
+            if (tables->load(argv[i + 1]) == 0) {
+                std::cerr << "No endgame tables in " << argv[i + 1] << std::endl;
+                return 1;
+            }
+            tablebases = std::move(tables);
+        }
+    }
+
+    // Node and depth limits on their own keep a run reproducible, they don't get a time limit added
+    if (limits.seconds <= 0 && limits.nodes <= 0 && !depthGiven) limits.seconds = 1.0;
+
+    std::ifstream in(argv[1]);
+    std::vector<EpdPosition> positions;
+    std::string line;
+    while (std::getline(in, line)) {
+        EpdPosition position;
+        if (parseEpd(line, position)) {
+            if (position.id.empty()) position.id = "#" + std::to_string(positions.size() + 1);
+            positions.push_back(position);
+        }
+    }
+    if (positions.empty()) {
+        std::cerr << "No EPD positions with bm or am in " << argv[1] << std::endl;
+        return 1;
+    }
+
+    std::vector<EpdResult> results(positions.size());
+    std::atomic<size_t> next{0};
+    std::mutex outputMutex;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&] {
+            auto board = std::make_unique<ChessBoard>();
+            board->tablebases = tablebases;
+            for (size_t i = next++; i < positions.size(); i = next++) {
+                results[i] = solve(*board, positions[i], limits, maxDepth);
+                std::lock_guard<std::mutex> lock(outputMutex);
+                const EpdResult &result = results[i];
+                std::cout << (result.solved ? "solved " : result.searched ? "failed " : "bad fen ") << positions[i].id
+                          << ": " << (result.move.empty() ? "-" : result.move) << " ("
+                          << (positions[i].bestMoves.empty() ? "am" : "bm");
+                for (const auto &move: positions[i].bestMoves.empty() ? positions[i].avoidMoves : positions[i].bestMoves) {
+                    std::cout << " " << move;
+                }
+                std::cout << ") " << result.nodes << " nodes " << result.seconds << " s" << std::endl;
+            }
+        });
+    }
+    for (auto &worker: workers) worker.join();
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int solved = 0;
+    long long nodes = 0;
+    double solveTime = 0;
+    for (const EpdResult &result: results) {
+        nodes += result.nodes;
+        if (result.solved) {
+            solved++;
+            solveTime += result.solvedAfter;
+        }
+    }
+    std::cout << "===========================" << std::endl;
+    std::cout << "Solved: " << solved << "/" << positions.size() << std::endl;
+    std::cout << "Average time to solution: " << (solved ? solveTime / solved : 0.0) << " s" << std::endl;
+    std::cout << "Nodes: " << nodes << ", " << threads << " threads, " << wallSeconds << " s" << std::endl;
+    std::cout << "Nodes/second: " << static_cast<long long>(nodes / std::max(wallSeconds, 1e-9)) << std::endl;
+    return 0;
+}
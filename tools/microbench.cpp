@@ -0,0 +1,111 @@
+// Per-call cost of the primitives the search is built from, each timed on its own.
+//   microbench [filter] [seconds per benchmark]
+// Every benchmark runs over the same few positions (opening, middlegame, endgame) and repeats until the
+// time budget is spent, so the numbers are comparable between runs and builds. Only the benchmarks whose
+// name contains filter are run.
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include "../ChessBoard.cpp"
+
+static const char *const fixturePositions[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+        "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+        "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11",
+        "8/pp2r1k1/2p1p3/3pP2p/1P1P1P1P/P5KR/8/8 w - - 0 1",
+};
+
+// A fixture is one board per position; the benchmark body gets a board and returns something derived
+// from its work, which is summed into a checksum so the compiler can't drop the call.
+struct Fixture {
+    std::vector<std::unique_ptr<ChessBoard>> boards;
+
+    Fixture() {
+        for (const char *fen: fixturePositions) {
+            boards.push_back(std::make_unique<ChessBoard>());
+            boards.back()->loadFen(fen);
+        }
+    }
+};
+
+struct Benchmark {
+    const char *name;
+    Fixture *fixture;
+    long long callsPerPass; // calls of the primitive in one pass over the fixture, to report the time per call
+    std::function<long long(ChessBoard &, size_t)> body; // the board and its index in the fixture
+};
+
+static long long checksum = 0;
+
+static void run(const Benchmark &benchmark, double budget) {
+    using Clock = std::chrono::steady_clock;
+    const auto &boards = benchmark.fixture->boards;
+    long long passes = 0;
+    auto start = Clock::now();
+    double elapsed = 0;
+    // Batches of passes between clock reads so the clock doesn't dominate the cheap primitives
+    for (long long batch = 1; elapsed < budget; batch = std::min(batch * 2, 1LL << 16)) {
+        for (long long i = 0; i < batch; i++) {
+            for (size_t index = 0; index < boards.size(); index++) checksum += benchmark.body(*boards[index], index);
+        }
+        passes += batch;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    double calls = static_cast<double>(passes) * benchmark.callsPerPass;
+    std::printf("%-28s %10.1f ns/call %14.0f calls\n", benchmark.name, elapsed * 1e9 / calls, calls);
+}
+
+int main(int argc, char *argv[]) {
+    std::string filter = argc > 1 ? argv[1] : "";
+    double budget = argc > 2 ? std::atof(argv[2]) : 0.5;
+
+    Fixture fixture;
+    Fixture uncached;
+    // shortEvalBoard would only be measuring eval cache hits otherwise
+    for (auto &board: uncached.boards) board->evalCache.resize(0);
+    long long positions = static_cast<long long>(fixture.boards.size());
+
+    // The make/unmake pair runs over every legal move of each position
+    std::vector<std::vector<Move>> moves;
+    long long totalMoves = 0;
+    for (auto &board: fixture.boards) {
+        moves.push_back(board->generateMovesForColor(board->whitesTurn));
+        totalMoves += static_cast<long long>(moves.back().size());
+    }
+
+    const std::vector<Benchmark> benchmarks = {
+            {"generateMovesForColor", &fixture, positions, [](ChessBoard &board, size_t) {
+                return static_cast<long long>(board.generateMovesForColor(board.whitesTurn).size());
+            }},
+            {"isSquareThreatened", &fixture, 64 * positions, [](ChessBoard &board, size_t) {
+                long long threatened = 0;
+                for (int square = 0; square < 64; square++) threatened += board.isSquareThreatened(square, board.whitesTurn);
+                return threatened;
+            }},
+            {"computeHash", &fixture, positions, [](ChessBoard &board, size_t) {
+                return static_cast<long long>(board.computeHash(board.whitesTurn) & 0xFFFF);
+            }},
+            {"movePiece+resetPreviousMove", &fixture, totalMoves, [&moves](ChessBoard &board, size_t index) {
+                for (const Move &move: moves[index]) {
+                    board.movePiece(move);
+                    board.resetPreviousMove();
+                }
+                return static_cast<long long>(board.hashKey & 0xFFFF);
+            }},
+            {"shortEvalBoard", &uncached, positions, [](ChessBoard &board, size_t) {
+                return static_cast<long long>(board.shortEvalBoard(board.whitesTurn));
+            }},
+            {"shortEvalBoard (cached)", &fixture, positions, [](ChessBoard &board, size_t) {
+                return static_cast<long long>(board.shortEvalBoard(board.whitesTurn));
+            }},
+    };
+
+    for (const Benchmark &benchmark: benchmarks) {
+        if (std::string(benchmark.name).find(filter) != std::string::npos) run(benchmark, budget);
+    }
+    std::printf("checksum %lld\n", checksum);
+    return 0;
+}
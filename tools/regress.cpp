@@ -0,0 +1,120 @@
+// Checks perft counts and fixed-depth searches against the numbers recorded in a golden file.
+//   regress [golden file] [--update]
+// Each golden line is one of
+//   perft <depth> <leaf nodes> <fen>
+//   search <depth> <nodes> <best move> <fen>
+// A search starts from empty hash tables and counts nodes + qnodes, so any change to move generation,
+// ordering, pruning or eval shows up as a different count. With --update the file is rewritten with the
+// current results for the same positions; review the diff before committing it. Perft counts are facts,
+// not results, so --update never rewrites them and leaves the file alone while one of them fails.
+#include <chrono>
+#include <fstream>
+#include <memory>
+// The node counts come from the search statistics, keep them in builds that compile them out
+#undef NO_SEARCH_STATS
+#include "../ChessBoard.cpp"
+
+#ifndef REGRESS_GOLDEN
+#define REGRESS_GOLDEN "tools/regress.golden"
+#endif
+
+struct GoldenEntry {
+    std::string kind; // "perft" or "search"
+    int depth = 0;
+    long long nodes = 0;
+    std::string bestMove;
+    std::string fen;
+};
+
+static bool parseEntry(const std::string &line, GoldenEntry &entry) {
+    std::istringstream stream(line);
+    if (!(stream >> entry.kind >> entry.depth >> entry.nodes)) return false;
+    if (entry.kind == "search" && !(stream >> entry.bestMove)) return false;
+    if (entry.kind != "perft" && entry.kind != "search") return false;
+    std::getline(stream >> std::ws, entry.fen);
+    return !entry.fen.empty();
+}
+
+static std::string formatEntry(const GoldenEntry &entry) {
+    std::string line = entry.kind + " " + std::to_string(entry.depth) + " " + std::to_string(entry.nodes) + " ";
+    if (entry.kind == "search") line += entry.bestMove + " ";
+    return line + entry.fen;
+}
+
+// Runs the entry on board and returns it with the counts it produced now
+static GoldenEntry measure(ChessBoard &board, const GoldenEntry &entry) {
+    GoldenEntry result = entry;
+    board.loadFen(entry.fen);
+    if (entry.kind == "perft") {
+        result.nodes = static_cast<long long>(board.perft(entry.depth, board.whitesTurn));
+        return result;
+    }
+    board.clearHashTables();
+    board.searchStats = ChessBoard::SearchStats();
+    Move best = board.searchBestMove(board.whitesTurn, entry.depth);
+    result.nodes = board.getSearchStats().nodes + board.getSearchStats().qnodes;
+    result.bestMove = board.rootMoves.empty() ? "0000" : board.moveToUci(best);
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    std::string path = REGRESS_GOLDEN;
+    bool update = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--update") {
+            update = true;
+        } else {
+            path = arg;
+        }
+    }
+
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Can't read " << path << std::endl;
+        return 1;
+    }
+    // Comments and blank lines are kept as they are when updating
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(in, line)) lines.push_back(line);
+    in.close();
+
+    auto board = std::make_unique<ChessBoard>();
+    int checked = 0, failed = 0, perftFailed = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (std::string &golden: lines) {
+        if (golden.empty() || golden[0] == '#') continue;
+        GoldenEntry entry;
+        if (!parseEntry(golden, entry)) {
+            std::cerr << "Bad golden line: " << golden << std::endl;
+            return 1;
+        }
+        GoldenEntry result = measure(*board, entry);
+        checked++;
+        if (result.nodes != entry.nodes || result.bestMove != entry.bestMove) {
+            failed++;
+            bool perft = entry.kind == "perft";
+            if (perft) perftFailed++;
+            std::cout << (update && !perft ? "UPDATED " : "FAIL ") << formatEntry(entry) << std::endl
+                      << "    now " << result.nodes << " nodes" << (result.kind == "search" ? ", " + result.bestMove : "")
+                      << std::endl;
+            if (!perft) golden = formatEntry(result);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (update && perftFailed > 0) {
+        std::cout << perftFailed << " perft counts wrong, move generation is broken; " << path << " not rewritten"
+                  << std::endl;
+        return 1;
+    }
+    if (update) {
+        std::ofstream out(path);
+        for (const std::string &golden: lines) out << golden << "\n";
+        std::cout << failed << " of " << checked << " entries changed, " << path << " rewritten" << std::endl;
+        return 0;
+    }
+    std::cout << checked - failed << "/" << checked << " match (" << seconds << " s)" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
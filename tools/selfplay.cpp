@@ -0,0 +1,390 @@
+// Engine against engine matches between two configurations, with Elo and an SPRT stopping rule.
+//   selfplay [--a option]... [--b option]... [--games n] [--threads n] [--nodes n | --movetime s | --tc base+inc]
+//            [--depth d] [--openings file] [--pgn file] [--tb directory] [--sprt elo0 elo1] [--alpha a] [--beta b]
+// Options configure one side: name=<label>, params=<eval params file>, nnue=<weights file>, one of the
+// search tunables below as <tunable>=<value>, or anything else as an eval weight (EvalParams::set).
+// Every opening is played twice with the colors swapped. Games run concurrently on their own boards, one
+// game per thread; the match ends after --games games or as soon as the SPRT accepts a hypothesis. The
+// endgame tables of --tb are mapped once and probed by every board.
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "../ChessBoard.cpp"
+
+static const char *const defaultOpenings[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "rnbqkbnr/pp1ppppp/8/2p5/4P3/8/PPPP1PPP/RNBQKBNR w KQkq - 0 2",
+        "rnbqkbnr/pppp1ppp/4p3/8/4P3/8/PPPP1PPP/RNBQKBNR w KQkq - 0 2",
+        "rnbqkbnr/pp1ppppp/2p5/8/4P3/8/PPPP1PPP/RNBQKBNR w KQkq - 0 2",
+        "r1bqkbnr/pppp1ppp/2n5/1B2p3/4P3/5N2/PPPP1PPP/RNBQK2R b KQkq - 3 3",
+        "r1bqkbnr/pppp1ppp/2n5/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R b KQkq - 3 3",
+        "rnbqkb1r/pppppppp/5n2/8/3P4/8/PPP1PPPP/RNBQKBNR w KQkq - 1 2",
+        "rnbqkbnr/ppp1pppp/8/3p4/2PP4/8/PP2PPPP/RNBQKBNR b KQkq - 0 2",
+        "rnbqkb1r/pppppp1p/5np1/8/2PP4/8/PP2PPPP/RNBQKBNR w KQkq - 0 3",
+        "rnbqkb1r/pppp1ppp/4pn2/8/2PP4/8/PP2PPPP/RNBQKBNR w KQkq - 0 3",
+        "rnbqkbnr/pppppppp/8/8/2P5/8/PP1PPPPP/RNBQKBNR b KQkq - 0 1",
+        "rnbqkbnr/pppppppp/8/8/8/5N2/PPPPPPPP/RNBQKB1R b KQkq - 1 1",
+        "rnbqkbnr/ppp1pppp/8/3p4/4P3/8/PPPP1PPP/RNBQKBNR w KQkq - 0 2",
+        "rnbqkbnr/pppp1ppp/8/4p3/2P5/8/PP1PPPPP/RNBQKBNR w KQkq - 0 2",
+        "rnbqkb1r/pp2pppp/3p1n2/8/3NP3/8/PPP2PPP/RNBQKB1R w KQkq - 1 5",
+        "rnbqk2r/ppppppbp/5np1/8/2PP4/2N5/PP2PPPP/R1BQKBNR w KQkq - 2 4",
+};
+
+// Search tunables an option can set, everything else is taken as an eval weight
+static const std::pair<const char *, int ChessBoard::*> intTunables[] = {
+        {"singularMinDepth", &ChessBoard::singularMinDepth}, {"singularMargin", &ChessBoard::singularMargin},
+        {"drawScore", &ChessBoard::drawScore}, {"lazyEvalMargin", &ChessBoard::lazyEvalMargin},
+        {"nullMoveMinDepth", &ChessBoard::nullMoveMinDepth}, {"nullMoveReduction", &ChessBoard::nullMoveReduction},
+        {"lmrMinDepth", &ChessBoard::lmrMinDepth}, {"lmrFullDepthMoves", &ChessBoard::lmrFullDepthMoves},
+        {"reverseFutilityMaxDepth", &ChessBoard::reverseFutilityMaxDepth},
+        {"reverseFutilityMargin", &ChessBoard::reverseFutilityMargin},
+        {"razorMaxDepth", &ChessBoard::razorMaxDepth}, {"razorMargin", &ChessBoard::razorMargin},
+        {"futilityMaxDepth", &ChessBoard::futilityMaxDepth}, {"futilityMargin", &ChessBoard::futilityMargin},
+        {"lateMovePruningMaxDepth", &ChessBoard::lateMovePruningMaxDepth},
+        {"lateMovePruningBase", &ChessBoard::lateMovePruningBase},
+};
+
+struct EngineConfig {
+    std::string name;
+    std::vector<std::string> options;
+
+    bool apply(ChessBoard &board) const {
+        for (const std::string &option: options) {
+            size_t equals = option.find('=');
+            std::string key = option.substr(0, equals);
+            std::string value = equals == std::string::npos ? "" : option.substr(equals + 1);
+            if (key == "name") continue;
+            if (key == "params") {
+                if (!board.loadEvalParams(value)) return false;
+                continue;
+            }
+            if (key == "nnue") {
+                if (!board.loadNnue(value)) return false;
+                continue;
+            }
+            if (key == "lmrBase" || key == "lmrDivisor") {
+                (key == "lmrBase" ? board.lmrBase : board.lmrDivisor) = std::atof(value.c_str());
+                board.initLmrTable();
+                continue;
+            }
+            bool tunable = false;
+            for (const auto &entry: intTunables) {
+                if (key == entry.first) {
+                    board.*entry.second = std::atoi(value.c_str());
+                    tunable = true;
+                }
+            }
+            if (!tunable && !board.setEvalParam(option)) {
+                std::cerr << "Unknown option for " << name << ": " << option << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+struct TimeControl {
+    long long nodes = 0;     // per move
+    double moveTime = 0;     // seconds per move
+    double base = 0;         // seconds per game and side, with increment added after each move
+    double increment = 0;
+    int depth = 64;
+};
+
+// Score counts for engine A
+struct MatchResult {
+    int wins = 0, draws = 0, losses = 0;
+
+    int games() const {
+        return wins + draws + losses;
+    }
+
+    double score() const {
+        return games() ? (wins + 0.5 * draws) / games() : 0.5;
+    }
+};
+
+static double eloFromScore(double score) {
+    score = std::min(std::max(score, 1e-6), 1 - 1e-6);
+    return -400.0 * std::log10(1.0 / score - 1.0);
+}
+
+static double scoreFromElo(double elo) {
+    return 1.0 / (1.0 + std::pow(10.0, -elo / 400.0));
+}
+
+// Elo difference and its 95% error margin from the spread of the per-game scores
+static void eloWithMargin(const MatchResult &result, double &elo, double &margin) {
+    int n = result.games();
+    double score = result.score();
+    elo = eloFromScore(score);
+    if (n < 2) {
+        margin = 0;
+        return;
+    }
+    double variance = (result.wins * std::pow(1 - score, 2) + result.draws * std::pow(0.5 - score, 2)
+                       + result.losses * std::pow(score, 2)) / n;
+    double deviation = 1.96 * std::sqrt(variance / n);
+    margin = (eloFromScore(score + deviation) - eloFromScore(score - deviation)) / 2;
+}
+
+// Log likelihood ratio of elo1 against elo0, the trinomial normal approximation of the GSPRT
+static double sprtLlr(const MatchResult &result, double elo0, double elo1) {
+    int n = result.games();
+    if (n == 0 || result.wins + result.draws == 0 || result.losses + result.draws == 0) return 0;
+    double wins = static_cast<double>(result.wins) / n, draws = static_cast<double>(result.draws) / n;
+    double score = wins + draws / 2;
+    double variance = wins + draws / 4 - score * score;
+    if (variance <= 0) return 0;
+    double s0 = scoreFromElo(elo0), s1 = scoreFromElo(elo1);
+    return (s1 - s0) * (2 * score - s0 - s1) / (2 * variance / n);
+}
+
+struct GameRecord {
+    std::string opening;
+    bool engineAWhite = true;
+    std::vector<std::string> sanMoves;
+    std::string result = "*"; // from white's point of view
+    std::string termination;
+};
+
+// Draws by material: bare kings, or a single minor piece against a bare king
+static bool insufficientMaterial(const ChessBoard &board) {
+    if (board.whitePawns | board.blackPawns | board.whiteRooks | board.blackRooks | board.whiteQueens |
+        board.blackQueens) {
+        return false;
+    }
+    int minors = __builtin_popcountll(board.whiteKnights | board.whiteBishops | board.blackKnights | board.blackBishops);
+    return minors <= 1;
+}
+
+// Plays one game on the two boards, each kept in step with every move. Returns false when stopped.
+static bool playGame(ChessBoard &engineA, ChessBoard &engineB, GameRecord &game, const TimeControl &control,
+                     const std::atomic<bool> &stop) {
+    ChessBoard *white = game.engineAWhite ? &engineA : &engineB;
+    ChessBoard *black = game.engineAWhite ? &engineB : &engineA;
+    for (ChessBoard *board: {white, black}) {
+        if (!board->loadFen(game.opening)) return false;
+        board->clearHashTables();
+    }
+    double clock[2] = {control.base, control.base}; // white, black
+    for (int ply = 0; ply < 600; ply++) {
+        ChessBoard &mover = white->whitesTurn ? *white : *black;
+        bool whiteToMove = mover.whitesTurn;
+        int side = whiteToMove ? 0 : 1;
+        if (mover.generateMovesForColoren(whiteToMove).empty()) {
+            bool mated = mover.isKingInCheck(whiteToMove);
+            game.result = mated ? (whiteToMove ? "0-1" : "1-0") : "1/2-1/2";
+            game.termination = mated ? "checkmate" : "stalemate";
+            return true;
+        }
+        if (mover.halfmoveClock >= 100 || mover.isRepetition(0) || insufficientMaterial(mover)) {
+            game.result = "1/2-1/2";
+            game.termination = mover.halfmoveClock >= 100 ? "fifty moves" : mover.isRepetition(0) ? "repetition"
+                                                                                                  : "insufficient material";
+            return true;
+        }
+
+        mover.searchLimits = ChessBoard::SearchLimits();
+        mover.searchLimits.nodes = control.nodes;
+        mover.searchLimits.seconds = control.moveTime;
+        if (control.base > 0) mover.searchLimits.seconds = clock[side] / 30 + control.increment * 0.8;
+        mover.searchLimits.stop = &stop;
+        auto start = std::chrono::steady_clock::now();
+        Move best = mover.searchBestMove(whiteToMove, control.depth);
+        if (stop) return false;
+        if (!best.pieceMoved) best = mover.generateMovesForColoren(whiteToMove).front(); // stopped in the first iteration
+        if (control.base > 0) {
+            clock[side] -= std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (clock[side] < 0) {
+                game.result = whiteToMove ? "0-1" : "1-0";
+                game.termination = "time forfeit";
+                return true;
+            }
+            clock[side] += control.increment;
+        }
+
+        // The other board gets the same move by name, moves point into the board that made them
+        std::string uci = mover.moveToUci(best);
+        game.sanMoves.push_back(mover.moveToSan(best));
+        for (ChessBoard *board: {white, black}) {
+            Move move;
+            if (!board->parseMove(uci, whiteToMove, move)) return false;
+            board->movePiece(move);
+            board->whitesTurn = !board->whitesTurn;
+        }
+    }
+    game.result = "1/2-1/2";
+    game.termination = "move limit";
+    return true;
+}
+
+static void writePgn(std::ostream &out, const GameRecord &game, int round, const std::string &nameA,
+                     const std::string &nameB) {
+    char date[16];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y.%m.%d", std::localtime(&now));
+    out << "[Event \"selfplay\"]\n[Site \"?\"]\n[Date \"" << date << "\"]\n[Round \"" << round << "\"]\n"
+        << "[White \"" << (game.engineAWhite ? nameA : nameB) << "\"]\n"
+        << "[Black \"" << (game.engineAWhite ? nameB : nameA) << "\"]\n"
+        << "[Result \"" << game.result << "\"]\n[FEN \"" << game.opening << "\"]\n[SetUp \"1\"]\n"
+        << "[Termination \"" << game.termination << "\"]\n\n";
+    std::istringstream fen(game.opening);
+    std::string placement, side;
+    int halfmoves = 0, fullmove = 1;
+    fen >> placement >> side >> placement >> placement >> halfmoves >> fullmove;
+    bool whiteMoves = side != "b";
+    std::string line;
+    for (size_t i = 0; i < game.sanMoves.size(); i++) {
+        std::string token;
+        if (whiteMoves) token = std::to_string(fullmove) + ". ";
+        else if (i == 0) token = std::to_string(fullmove) + "... ";
+        token += game.sanMoves[i];
+        if (line.size() + token.size() + 1 > 79) {
+            out << line << "\n";
+            line.clear();
+        }
+        line += (line.empty() ? "" : " ") + token;
+        if (!whiteMoves) fullmove++;
+        whiteMoves = !whiteMoves;
+    }
+    out << line << (line.empty() ? "" : " ") << game.result << "\n\n";
+}
+
+int main(int argc, char *argv[]) {
+    EngineConfig engines[2] = {{"A", {}}, {"B", {}}};
+    TimeControl control;
+    int maxGames = 1000;
+    int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    std::string openingsPath, pgnPath;
+    std::shared_ptr<const Tablebases> tablebases;
+    double elo0 = 0, elo1 = 5, alpha = 0.05, beta = 0.05;
+    for (int i = 1; i + 1 < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--a" || option == "--b") {
+            EngineConfig &engine = engines[option == "--a" ? 0 : 1];
+            std::string value = argv[++i];
+            engine.options.push_back(value);
+            if (value.rfind("name=", 0) == 0) engine.name = value.substr(5);
+        } else if (option == "--games") {
+            maxGames = std::atoi(argv[++i]);
+        } else if (option == "--threads") {
+            threads = std::max(1, std::atoi(argv[++i]));
+        } else if (option == "--nodes") {
+            control.nodes = std::atoll(argv[++i]);
+        } else if (option == "--movetime") {
+            control.moveTime = std::atof(argv[++i]);
+        } else if (option == "--tc") {
+            std::string tc = argv[++i];
+            control.base = std::atof(tc.c_str());
+            size_t plus = tc.find('+');
+            if (plus != std::string::npos) control.increment = std::atof(tc.c_str() + plus + 1);
+        } else if (option == "--depth") {
+            control.depth = std::atoi(argv[++i]);
+        } else if (option == "--openings") {
+            openingsPath = argv[++i];
+        } else if (option == "--pgn") {
+            pgnPath = argv[++i];
+        } else if (option == "--tb") {
+            auto tables = std::make_shared<Tablebases>();
+            if (tables->load(argv[++i]) == 0) {
+                std::cerr << "No endgame tables in " << argv[i] << std::endl;
+                return 1;
+            }
+            tablebases = std::move(tables);
+        } else if (option == "--sprt" && i + 2 < argc) {
+            elo0 = std::atof(argv[++i]);
+            elo1 = std::atof(argv[++i]);
+        } else if (option == "--alpha") {
+            alpha = std::atof(argv[++i]);
+        } else if (option == "--beta") {
+            beta = std::atof(argv[++i]);
+        }
+    }
+    if (control.nodes <= 0 && control.moveTime <= 0 && control.base <= 0 && control.depth == 64) {
+        control.nodes = 20000;
+    }
+
+    std::vector<std::string> openings;
+    if (!openingsPath.empty()) {
+        std::ifstream in(openingsPath);
+        std::string line;
+        while (std::getline(in, line)) {
+            // EPD lines carry only four fields, loadFen defaults the move counters
+            if (!line.empty() && line[0] != '#') openings.push_back(line);
+        }
+    } else {
+        openings.assign(std::begin(defaultOpenings), std::end(defaultOpenings));
+    }
+    if (openings.empty()) {
+        std::cerr << "No openings" << std::endl;
+        return 1;
+    }
+    for (EngineConfig &engine: engines) {
+        auto check = std::make_unique<ChessBoard>();
+        if (!engine.apply(*check)) return 1;
+    }
+
+    double lowerBound = std::log(beta / (1 - alpha)), upperBound = std::log((1 - beta) / alpha);
+    std::ofstream pgn;
+    if (!pgnPath.empty()) pgn.open(pgnPath);
+    MatchResult match;
+    std::atomic<int> nextGame{0};
+    std::atomic<bool> stop{false};
+    std::mutex resultMutex;
+    std::string verdict;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&] {
+            auto engineA = std::make_unique<ChessBoard>();
+            auto engineB = std::make_unique<ChessBoard>();
+            if (!engines[0].apply(*engineA) || !engines[1].apply(*engineB)) return;
+            engineA->tablebases = engineB->tablebases = tablebases;
+            for (int index = nextGame++; index < maxGames && !stop; index = nextGame++) {
+                GameRecord game;
+                game.opening = openings[(index / 2) % openings.size()];
+                game.engineAWhite = index % 2 == 0;
+                if (!playGame(*engineA, *engineB, game, control, stop)) continue;
+
+                std::lock_guard<std::mutex> lock(resultMutex);
+                if (stop) break; // decided while this game was running, it doesn't count
+                bool whiteWon = game.result == "1-0", blackWon = game.result == "0-1";
+                if (!whiteWon && !blackWon) {
+                    match.draws++;
+                } else if (whiteWon == game.engineAWhite) {
+                    match.wins++;
+                } else {
+                    match.losses++;
+                }
+                if (pgn.is_open()) writePgn(pgn, game, index + 1, engines[0].name, engines[1].name);
+                double llr = sprtLlr(match, elo0, elo1);
+                double elo, margin;
+                eloWithMargin(match, elo, margin);
+                std::cout << "Game " << match.games() << " (" << game.result << ", " << game.termination << "): "
+                          << engines[0].name << " +" << match.wins << " =" << match.draws << " -" << match.losses
+                          << "  Elo " << elo << " +/- " << margin << "  LLR " << llr
+                          << " [" << lowerBound << ", " << upperBound << "]" << std::endl;
+                if (llr >= upperBound || llr <= lowerBound) {
+                    verdict = llr >= upperBound ? "H1 accepted" : "H0 accepted";
+                    stop = true;
+                }
+            }
+        });
+    }
+    for (auto &worker: workers) worker.join();
+
+    double elo, margin;
+    eloWithMargin(match, elo, margin);
+    std::cout << "===========================" << std::endl;
+    std::cout << engines[0].name << " vs " << engines[1].name << ": +" << match.wins << " =" << match.draws << " -"
+              << match.losses << " (" << match.games() << " games, score " << match.score() << ")" << std::endl;
+    std::cout << "Elo difference: " << elo << " +/- " << margin << std::endl;
+    std::cout << "SPRT elo0=" << elo0 << " elo1=" << elo1 << ": LLR " << sprtLlr(match, elo0, elo1) << ", "
+              << (verdict.empty() ? "inconclusive" : verdict) << std::endl;
+    return 0;
+}
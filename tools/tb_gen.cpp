@@ -0,0 +1,378 @@
+// Generates endgame tables (see Tablebase.h) by retrograde analysis.
+//   tbgen <directory> [material ...]
+// Materials are named like the files: KQvK, KBNvK, KQvKR. The tables that captures and promotions lead
+// to are generated first when the directory doesn't have them yet. Without materials it makes all the
+// 3 piece tables and KBNvK, KBBvK, KQvKR, KRvKB and KRvKN.
+//
+// A table starts from the mates and the moves that leave it (captures and promotions, looked up in the
+// smaller tables). Ply by ply, the positions one move before a loss become wins, and the positions one
+// move before a win are checked for being lost, until nothing changes. What is left is a draw.
+#include <chrono>
+#include <climits>
+#include <iostream>
+#include "../Tablebase.h"
+
+static uint64_t kingAttacks[64], knightAttacks[64];
+
+static void initAttacks() {
+    const int kingSteps[8][2] = {{1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}, {0, -1}, {1, -1}};
+    const int knightSteps[8][2] = {{1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}};
+    for (int square = 0; square < 64; square++) {
+        int file = square % 8, rank = square / 8;
+        for (int i = 0; i < 8; i++) {
+            int kingFile = file + kingSteps[i][0], kingRank = rank + kingSteps[i][1];
+            if (kingFile >= 0 && kingFile < 8 && kingRank >= 0 && kingRank < 8) {
+                kingAttacks[square] |= 1ULL << (kingRank * 8 + kingFile);
+            }
+            int knightFile = file + knightSteps[i][0], knightRank = rank + knightSteps[i][1];
+            if (knightFile >= 0 && knightFile < 8 && knightRank >= 0 && knightRank < 8) {
+                knightAttacks[square] |= 1ULL << (knightRank * 8 + knightFile);
+            }
+        }
+    }
+}
+
+static uint64_t slide(int square, uint64_t occupied, bool straight, bool diagonal) {
+    const int directions[8][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+    uint64_t attacks = 0;
+    for (int i = straight ? 0 : 4; i < (diagonal ? 8 : 4); i++) {
+        int file = square % 8 + directions[i][0], rank = square / 8 + directions[i][1];
+        while (file >= 0 && file < 8 && rank >= 0 && rank < 8) {
+            uint64_t target = 1ULL << (rank * 8 + file);
+            attacks |= target;
+            if (occupied & target) break;
+            file += directions[i][0];
+            rank += directions[i][1];
+        }
+    }
+    return attacks;
+}
+
+static uint64_t pawnAttacks(bool white, int square) {
+    uint64_t pawn = 1ULL << square;
+    uint64_t notAFile = 0xfefefefefefefefeULL, notHFile = 0x7f7f7f7f7f7f7f7fULL;
+    return white ? ((pawn & notAFile) << 7) | ((pawn & notHFile) << 9)
+                 : ((pawn & notAFile) >> 9) | ((pawn & notHFile) >> 7);
+}
+
+// Squares a piece of kind attacks, for pawns only the captures
+static uint64_t attacks(int kind, int square, uint64_t occupied) {
+    switch (kind % 6) {
+        case 0: return pawnAttacks(kind < 6, square);
+        case 1: return knightAttacks[square];
+        case 2: return slide(square, occupied, false, true);
+        case 3: return slide(square, occupied, true, false);
+        case 4: return slide(square, occupied, true, true);
+        default: return kingAttacks[square];
+    }
+}
+
+class Generator {
+public:
+    Generator(const TbMaterial &material, const Tablebases &tables) : material(material), tables(tables) {}
+
+    std::vector<uint8_t> run() {
+        size_t size = material.size();
+        values.assign(size, Tablebases::INVALID);
+        std::vector<std::vector<uint32_t>> exitWins(Tablebases::MAX_PLIES + 2), exitLosses(Tablebases::MAX_PLIES + 2);
+        std::vector<uint32_t> previous, current;
+        std::vector<uint8_t> checkedAt(size, 0); // ply of the last loss check, a position can have many won children
+
+        // Which positions can occur, the mates and stalemates, and what the captures and promotions bring
+        for (size_t index = 0; index < size; index++) {
+            int squares[TbMaterial::MAX_PIECES];
+            bool whiteToMove;
+            material.squaresOf(index, squares, whiteToMove);
+            if (valid(squares, whiteToMove)) values[index] = UNKNOWN;
+        }
+        for (size_t index = 0; index < size; index++) {
+            if (values[index] != UNKNOWN) continue;
+            int squares[TbMaterial::MAX_PIECES];
+            bool whiteToMove;
+            material.squaresOf(index, squares, whiteToMove);
+            bool anyMove = false, drawExit = false;
+            int fastestWin = INT_MAX, slowestLoss = -1;
+            forEachMove(squares, whiteToMove, [&](uint8_t child, bool exit) {
+                anyMove = true;
+                if (!exit) return;
+                if (child == Tablebases::DRAW) {
+                    drawExit = true;
+                } else if (Tablebases::isWin(child)) {
+                    slowestLoss = std::max(slowestLoss, Tablebases::plies(child) + 1);
+                } else {
+                    fastestWin = std::min(fastestWin, Tablebases::plies(child) + 1);
+                }
+            });
+            if (!anyMove) {
+                bool inCheck = attacked(squares[whiteToMove ? 0 : 1], !whiteToMove, squares);
+                values[index] = inCheck ? Tablebases::valueFor(0) : Tablebases::DRAW;
+                if (inCheck) previous.push_back(static_cast<uint32_t>(index));
+            } else if (fastestWin <= Tablebases::MAX_PLIES) {
+                exitWins[fastestWin].push_back(static_cast<uint32_t>(index));
+            } else if (!drawExit && slowestLoss >= 0 && slowestLoss <= Tablebases::MAX_PLIES) {
+                exitLosses[slowestLoss].push_back(static_cast<uint32_t>(index)); // lost if the other moves lose too
+            }
+        }
+
+        int lastExit = 0;
+        for (int ply = 0; ply <= Tablebases::MAX_PLIES; ply++) {
+            if (!exitWins[ply].empty() || !exitLosses[ply].empty()) lastExit = ply;
+        }
+        for (int ply = 1; ply <= Tablebases::MAX_PLIES && (!previous.empty() || ply <= lastExit); ply++) {
+            bool wins = ply % 2 == 1;
+            current.clear();
+            auto resolve = [&](size_t index) {
+                if (values[index] != UNKNOWN || (!wins && checkedAt[index] == ply)) return;
+                checkedAt[index] = static_cast<uint8_t>(ply);
+                if (wins || lostWithin(index, ply)) {
+                    values[index] = Tablebases::valueFor(ply);
+                    current.push_back(static_cast<uint32_t>(index));
+                }
+            };
+            for (uint32_t index: previous) forEachPredecessor(index, resolve);
+            for (uint32_t index: (wins ? exitWins : exitLosses)[ply]) resolve(index);
+            previous.swap(current);
+            if (!previous.empty()) longestMate = ply;
+        }
+        for (uint8_t &value: values) {
+            if (value == UNKNOWN) value = Tablebases::DRAW;
+        }
+        return std::move(values);
+    }
+
+    int longestMate = 0;
+
+private:
+    static constexpr uint8_t UNKNOWN = 254; // a valid position without a result yet
+
+    const TbMaterial &material;
+    const Tablebases &tables;
+    std::vector<uint8_t> values;
+
+    uint64_t occupancy(const int *squares) const {
+        uint64_t occupied = 0;
+        for (int i = 0; i < material.count; i++) {
+            if (squares[i] >= 0) occupied |= 1ULL << squares[i];
+        }
+        return occupied;
+    }
+
+    // Whether a piece of the given colour attacks square, captured pieces have square -1
+    bool attacked(int square, bool byWhite, const int *squares) const {
+        uint64_t occupied = occupancy(squares);
+        for (int i = 0; i < material.count; i++) {
+            int kind = material.kinds[i];
+            if (squares[i] >= 0 && (kind < 6) == byWhite && (attacks(kind, squares[i], occupied) & (1ULL << square))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool valid(const int *squares, bool whiteToMove) const {
+        uint64_t occupied = 0;
+        for (int i = 0; i < material.count; i++) {
+            uint64_t square = 1ULL << squares[i];
+            if (occupied & square) return false;
+            occupied |= square;
+            if (material.kinds[i] % 6 == 0 && (squares[i] < 8 || squares[i] >= 56)) return false;
+        }
+        return !attacked(squares[whiteToMove ? 1 : 0], whiteToMove, squares);
+    }
+
+    // Calls visit(value of the position after the move, whether the move leaves the table) for every
+    // legal move
+    template<typename Visit>
+    void forEachMove(const int *squares, bool whiteToMove, Visit visit) const {
+        uint64_t occupied = occupancy(squares);
+        uint64_t own = 0;
+        for (int i = 0; i < material.count; i++) {
+            if ((material.kinds[i] < 6) == whiteToMove) own |= 1ULL << squares[i];
+        }
+        for (int piece = 0; piece < material.count; piece++) {
+            int kind = material.kinds[piece], from = squares[piece];
+            if ((kind < 6) != whiteToMove) continue;
+            uint64_t targets;
+            if (kind % 6 == 0) {
+                int forward = whiteToMove ? 8 : -8;
+                targets = pawnAttacks(whiteToMove, from) & occupied & ~own;
+                if (!(occupied & (1ULL << (from + forward)))) {
+                    targets |= 1ULL << (from + forward);
+                    bool startRank = whiteToMove ? from / 8 == 1 : from / 8 == 6;
+                    if (startRank && !(occupied & (1ULL << (from + 2 * forward)))) targets |= 1ULL << (from + 2 * forward);
+                }
+            } else {
+                targets = attacks(kind, from, occupied) & ~own;
+            }
+            while (targets) {
+                int to = __builtin_ctzll(targets);
+                targets &= targets - 1;
+                int child[TbMaterial::MAX_PIECES];
+                std::copy(squares, squares + material.count, child);
+                bool capture = false;
+                for (int i = 0; i < material.count; i++) {
+                    if (child[i] == to) {
+                        child[i] = -1;
+                        capture = true;
+                    }
+                }
+                child[piece] = to;
+                if (attacked(child[whiteToMove ? 0 : 1], !whiteToMove, child)) continue;
+                bool promotion = kind % 6 == 0 && (to < 8 || to >= 56);
+                if (!capture && !promotion) {
+                    visit(values[material.index(child, !whiteToMove)], false);
+                    continue;
+                }
+                for (int promoted = promotion ? 4 : kind % 6; promoted >= (promotion ? 1 : kind % 6); promoted--) {
+                    visit(exitValue(child, piece, promoted + (whiteToMove ? 0 : 6), !whiteToMove), true);
+                }
+            }
+        }
+    }
+
+    // Value of a position in another table, the piece that moved is now newKind
+    uint8_t exitValue(const int *squares, int moved, int newKind, bool whiteToMove) const {
+        int kinds[TbMaterial::MAX_PIECES], onSquares[TbMaterial::MAX_PIECES], count = 0;
+        for (int i = 0; i < material.count; i++) {
+            if (squares[i] < 0) continue;
+            kinds[count] = i == moved ? newKind : material.kinds[i];
+            onSquares[count++] = squares[i];
+        }
+        uint8_t value;
+        if (!tables.probe(kinds, onSquares, count, whiteToMove, value)) {
+            std::cerr << "A table " << material.name() << " depends on is missing" << std::endl;
+            std::exit(1);
+        }
+        return value;
+    }
+
+    // Lost in exactly ply plies: every move leads to a win for the other side within ply - 1
+    bool lostWithin(size_t index, int ply) const {
+        int squares[TbMaterial::MAX_PIECES];
+        bool whiteToMove;
+        material.squaresOf(index, squares, whiteToMove);
+        bool lost = true;
+        forEachMove(squares, whiteToMove, [&](uint8_t child, bool) {
+            if (!Tablebases::isWin(child) || child == UNKNOWN || Tablebases::plies(child) > ply - 1) lost = false;
+        });
+        return lost;
+    }
+
+    // Calls visit(index) for every position one quiet move (no capture, no promotion) before index, with
+    // the other side to move
+    template<typename Visit>
+    void forEachPredecessor(size_t index, Visit visit) const {
+        int squares[TbMaterial::MAX_PIECES];
+        bool whiteToMove;
+        material.squaresOf(index, squares, whiteToMove);
+        bool mover = !whiteToMove;
+        uint64_t occupied = occupancy(squares);
+        for (int piece = 0; piece < material.count; piece++) {
+            int kind = material.kinds[piece], to = squares[piece];
+            if ((kind < 6) != mover) continue;
+            uint64_t origins;
+            if (kind % 6 == 0) {
+                int back = mover ? -8 : 8;
+                origins = 0;
+                int from = to + back;
+                if (from >= 8 && from < 56 && !(occupied & (1ULL << from))) {
+                    origins |= 1ULL << from;
+                    bool doublePush = mover ? to / 8 == 3 : to / 8 == 4;
+                    if (doublePush && !(occupied & (1ULL << (from + back)))) origins |= 1ULL << (from + back);
+                }
+            } else {
+                origins = attacks(kind, to, occupied) & ~occupied;
+            }
+            while (origins) {
+                int from = __builtin_ctzll(origins);
+                origins &= origins - 1;
+                int parent[TbMaterial::MAX_PIECES];
+                std::copy(squares, squares + material.count, parent);
+                parent[piece] = from;
+                size_t parentIndex = material.index(parent, mover);
+                if (values[parentIndex] != Tablebases::INVALID) visit(parentIndex);
+            }
+        }
+    }
+};
+
+// Tables a material's captures and promotions lead to
+static std::vector<TbMaterial> dependencies(const TbMaterial &material) {
+    std::vector<TbMaterial> result;
+    for (int i = 2; i < material.count; i++) {
+        int kinds[TbMaterial::MAX_PIECES], count = 0;
+        for (int j = 0; j < material.count; j++) {
+            if (j != i) kinds[count++] = material.kinds[j];
+        }
+        TbMaterial captured;
+        captured.set(kinds, count);
+        result.push_back(captured);
+        if (material.kinds[i] % 6 != 0) continue;
+        for (int promoted = 1; promoted <= 4; promoted++) {
+            std::copy(material.kinds, material.kinds + material.count, kinds);
+            kinds[i] = material.kinds[i] + promoted;
+            TbMaterial promotion;
+            promotion.set(kinds, material.count);
+            result.push_back(promotion);
+        }
+    }
+    return result;
+}
+
+// The colours with the stronger side as white, the way the tables are stored
+static TbMaterial canonical(const TbMaterial &material) {
+    std::vector<int> white, black; // piece types, strongest first like the kinds
+    for (int i = 2; i < material.count; i++) (material.kinds[i] < 6 ? white : black).push_back(material.kinds[i] % 6);
+    bool blackStronger = black.size() != white.size() ? black.size() > white.size() : black > white;
+    return blackStronger ? material.flipped() : material;
+}
+
+static bool generate(const TbMaterial &material, const std::string &directory, Tablebases &tables) {
+    if (tables.has(material)) return true;
+    for (const TbMaterial &dependency: dependencies(material)) {
+        if (!generate(canonical(dependency), directory, tables)) return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    Generator generator(material, tables);
+    std::vector<uint8_t> values = generator.run();
+    size_t wins = 0, losses = 0, draws = 0;
+    for (uint8_t value: values) {
+        if (value == Tablebases::DRAW) draws++;
+        else if (Tablebases::isWin(value)) wins++;
+        else if (value != Tablebases::INVALID) losses++;
+    }
+    std::string path = directory + "/" + material.name() + ".tb";
+    if (!Tablebases::write(path, material, values) || !tables.open(path)) {
+        std::cerr << "Could not write " << path << std::endl;
+        return false;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << material.name() << ": " << wins << " wins, " << losses << " losses, " << draws << " draws, longest mate "
+              << generator.longestMate << " plies (" << seconds << " s)" << std::endl;
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: tbgen <directory> [material ...]" << std::endl;
+        return 1;
+    }
+    std::string directory = argv[1];
+    std::vector<std::string> names(argv + 2, argv + argc);
+    if (names.empty()) names = {"KQvK", "KRvK", "KBvK", "KNvK", "KPvK", "KBNvK", "KBBvK", "KQvKR", "KRvKB", "KRvKN"};
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    initAttacks();
+    Tablebases tables;
+    tables.load(directory);
+    for (const std::string &name: names) {
+        TbMaterial material;
+        if (!material.parse(name) || material.count < 3) {
+            std::cerr << "Not a material of 3 or 4 pieces: " << name << std::endl;
+            return 1;
+        }
+        if (!generate(canonical(material), directory, tables)) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,438 @@
+// Texel tuning of the classical evaluation terms against game results.
+//   texeltune <positions file> [--threads N] [--epochs N] [--rate R] [--params file] [--out file] [--tables file]
+// Every line of the positions file is a FEN (at least the piece placement) followed somewhere by the
+// game result: 1-0, 0-1, 1/2-1/2, or [1.0], [0.5], [0.0]. Lines without a result are skipped.
+//
+// The terms tuned are the ones linear in their weights: piece values, both halves of the PSTs, the
+// pawn structure terms, mobility, the king danger table and the threat terms. Scores are white relative,
+// material[white] - material[black] + taperedScore(everything else), which is evaluateBoard without the
+// per-side asymmetry of shortEvalBoard. Tuning starts from the compiled-in weights or a --params file.
+// The result is written as a parameter file for ChessBoard::loadEvalParams (--out) and as EvalParams
+// declarations to paste over the defaults (--tables).
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include "../ChessBoard.cpp"
+
+// 25 bytes per position: the occupancy, then a nibble per occupied square (lowest square first) holding
+// the zobrist piece index, then the result from white's side in half points.
+struct PackedPosition {
+    uint8_t occupied[8];
+    uint8_t pieces[16];
+    uint8_t result;
+};
+
+static int pieceIndexFor(char c) {
+    const char *pieceChars = "PNBRQKpnbrqk";
+    const char *found = std::strchr(pieceChars, c);
+    return found && c ? static_cast<int>(found - pieceChars) : -1;
+}
+
+static bool parseResult(const std::string &line, uint8_t &result) {
+    if (line.find("1/2-1/2") != std::string::npos || line.find("[0.5]") != std::string::npos) result = 1;
+    else if (line.find("1-0") != std::string::npos || line.find("[1.0]") != std::string::npos) result = 2;
+    else if (line.find("0-1") != std::string::npos || line.find("[0.0]") != std::string::npos) result = 0;
+    else return false;
+    return true;
+}
+
+static bool parsePosition(const std::string &line, PackedPosition &position) {
+    uint64_t bitboards[12] = {};
+    int rank = 7, file = 0;
+    size_t i = 0;
+    for (; i < line.size() && line[i] != ' '; i++) {
+        char c = line[i];
+        if (c == '/') {
+            rank--;
+            file = 0;
+        } else if (c >= '1' && c <= '8') {
+            file += c - '0';
+        } else {
+            int pieceIndex = pieceIndexFor(c);
+            if (pieceIndex < 0 || rank < 0 || file > 7) return false;
+            bitboards[pieceIndex] |= 1ULL << (rank * 8 + file);
+            file++;
+        }
+    }
+    if (i == 0 || !parseResult(line.substr(i), position.result)) return false;
+
+    uint64_t occupied = 0;
+    for (uint64_t bitboard: bitboards) occupied |= bitboard;
+    if (__builtin_popcountll(occupied) > 32) return false;
+    std::memcpy(position.occupied, &occupied, sizeof(occupied));
+    std::memset(position.pieces, 0, sizeof(position.pieces));
+    int n = 0;
+    for (uint64_t squares = occupied; squares; squares &= squares - 1, n++) {
+        uint64_t square = squares & -squares;
+        int pieceIndex = 0;
+        while (!(bitboards[pieceIndex] & square)) pieceIndex++;
+        position.pieces[n / 2] |= pieceIndex << (n % 2 * 4);
+    }
+    return true;
+}
+
+static void unpack(const PackedPosition &position, uint64_t bitboards[12]) {
+    uint64_t occupied;
+    std::memcpy(&occupied, position.occupied, sizeof(occupied));
+    std::fill(bitboards, bitboards + 12, 0);
+    int n = 0;
+    for (; occupied; occupied &= occupied - 1, n++) {
+        int pieceIndex = (position.pieces[n / 2] >> (n % 2 * 4)) & 0xF;
+        bitboards[pieceIndex] |= occupied & -occupied;
+    }
+}
+
+// The tuned parameters, numbered as in EvalTerms, each a middlegame and an endgame weight. Material weights
+// are not tapered and the king danger table only has a middlegame half, like in ChessBoard.
+struct Parameters : EvalTerms {
+    enum Kind { Flat, Tapered, MiddlegameOnly };
+
+    std::vector<double> values = std::vector<double>(2 * COUNT);
+
+    static Kind kindOf(int term) {
+        if (term < PST) return Flat;
+        if (term >= KING_DANGER && term < KING_DANGER + 16) return MiddlegameOnly;
+        return Tapered;
+    }
+
+    void set(int term, int packed) {
+        values[2 * term] = middlegameScore(packed);
+        values[2 * term + 1] = endgameScore(packed);
+    }
+
+    int rounded(int term, int half) const {
+        return static_cast<int>(std::lround(values[2 * term + half]));
+    }
+
+    static Parameters from(const EvalParams &params) {
+        Parameters parameters;
+        for (int type = 0; type < 5; type++) parameters.values[2 * (MATERIAL + type)] = params.pieceValue(type);
+        for (int type = 0; type < 6; type++) {
+            for (int square = 0; square < 64; square++) {
+                parameters.set(PST + type * 64 + square, params.positionalValue(type, square, true));
+            }
+            parameters.set(MOBILITY + type, params.mobilityBonus[type]);
+        }
+        parameters.set(DOUBLED, params.doubledPawnPenalty);
+        parameters.set(ISOLATED, params.isolatedPawnPenalty);
+        parameters.set(BACKWARD, params.backwardPawnPenalty);
+        for (int rank = 0; rank < 8; rank++) parameters.set(PASSED + rank, params.passedPawnBonus[rank]);
+        for (int i = 0; i < 16; i++) parameters.values[2 * (KING_DANGER + i)] = params.kingDangerBonus[i];
+        parameters.set(HANGING, params.hangingPiecePenalty);
+        parameters.set(DEFENDED, params.defendedPieceBonus);
+        parameters.set(THREATENED_BY_PAWN, params.threatenedByPawnPenalty);
+        parameters.set(THREATENED_BY_MINOR, params.threatenedByMinorPenalty);
+        return parameters;
+    }
+
+    int packed(int term) const {
+        return makeScore(rounded(term, 0), rounded(term, 1));
+    }
+
+    // The rounded weights on top of params, which keeps the untuned ones
+    EvalParams toEvalParams(EvalParams params) const {
+        int *pieceValues[5] = {&params.pawnValue, &params.knightValue, &params.bishopValue, &params.rookValue,
+                               &params.queenValue};
+        int *middlegameTables[6] = {params.pawnPositionalValue, params.knightPositionalValue,
+                                    params.bishopPositionalValue, params.rookPositionalValue,
+                                    params.queenPositionalValue, params.kingPositionalValue};
+        int *endgameTables[6] = {params.pawnEndgameValue, params.knightEndgameValue, params.bishopEndgameValue,
+                                 params.rookEndgameValue, params.queenEndgameValue, params.kingEndgameValue};
+        for (int type = 0; type < 5; type++) *pieceValues[type] = rounded(MATERIAL + type, 0);
+        for (int type = 0; type < 6; type++) {
+            for (int square = 0; square < 64; square++) {
+                middlegameTables[type][square] = rounded(PST + type * 64 + square, 0);
+                endgameTables[type][square] = rounded(PST + type * 64 + square, 1);
+            }
+            params.mobilityBonus[type] = packed(MOBILITY + type);
+        }
+        params.doubledPawnPenalty = packed(DOUBLED);
+        params.isolatedPawnPenalty = packed(ISOLATED);
+        params.backwardPawnPenalty = packed(BACKWARD);
+        for (int rank = 0; rank < 8; rank++) params.passedPawnBonus[rank] = packed(PASSED + rank);
+        for (int i = 0; i < 16; i++) params.kingDangerBonus[i] = rounded(KING_DANGER + i, 0);
+        params.hangingPiecePenalty = packed(HANGING);
+        params.defendedPieceBonus = packed(DEFENDED);
+        params.threatenedByPawnPenalty = packed(THREATENED_BY_PAWN);
+        params.threatenedByMinorPenalty = packed(THREATENED_BY_MINOR);
+        return params;
+    }
+};
+
+// One term of a position's score: coefficient times the term's weights
+struct Feature {
+    int term;
+    int coefficient;
+};
+
+// The terms ChessBoard reports for one side as features, sign is 1 for white and -1 for black
+struct FeatureTrace {
+    std::vector<Feature> *features;
+    int sign;
+
+    void add(int term, int count) {
+        if (count) features->push_back({term, sign * count});
+    }
+};
+
+// Only the bitboards, which is all the evaluation terms below read
+static void setPieces(ChessBoard &board, const uint64_t bitboards[12]) {
+    uint64_t *pieces[12] = {&board.whitePawns, &board.whiteKnights, &board.whiteBishops, &board.whiteRooks,
+                            &board.whiteQueens, &board.whiteKing, &board.blackPawns, &board.blackKnights,
+                            &board.blackBishops, &board.blackRooks, &board.blackQueens, &board.blackKing};
+    for (int i = 0; i < 12; i++) *pieces[i] = bitboards[i];
+    board.updateOccupiedSquares();
+}
+
+// Material and PST counted here, the pawn structure, attack and threat terms as ChessBoard's evaluation
+// reports them. board holds the position of bitboards, params supplies the weights that aren't tuned.
+static void addFeatures(ChessBoard &board, const uint64_t bitboards[12], const EvalParams &params,
+                        std::vector<Feature> &features) {
+    for (int side = 0; side < 2; side++) {
+        bool white = side == 0;
+        FeatureTrace trace{&features, white ? 1 : -1};
+        const uint64_t *own = bitboards + (white ? 0 : 6);
+        for (int type = 0; type < 6; type++) {
+            if (type < 5) trace.add(EvalTerms::MATERIAL + type, __builtin_popcountll(own[type]));
+            for (uint64_t pieces = own[type]; pieces; pieces &= pieces - 1) {
+                int square = __builtin_ctzll(pieces);
+                trace.add(EvalTerms::PST + type * 64 + (white ? square : 63 - square), 1);
+            }
+        }
+        ChessBoard::pawnStructureFor(own[0], bitboards[white ? 6 : 0], white, params, trace);
+    }
+    ChessBoard::AttackInfo info{};
+    board.pieceAttacksFor(0, info, params, FeatureTrace{&features, 1});
+    board.pieceAttacksFor(1, info, params, FeatureTrace{&features, -1});
+    board.threatsFor(0, info, params, FeatureTrace{&features, 1});
+    board.threatsFor(1, info, params, FeatureTrace{&features, -1});
+}
+
+static int phaseOf(const uint64_t bitboards[12]) {
+    int phase = __builtin_popcountll(bitboards[1] | bitboards[2] | bitboards[7] | bitboards[8])
+                + 2 * __builtin_popcountll(bitboards[3] | bitboards[9])
+                + 4 * __builtin_popcountll(bitboards[4] | bitboards[10]);
+    return std::min(phase, static_cast<int>(ChessBoard::maxGamePhase));
+}
+
+// d score / d weight for the middlegame and endgame half of a feature's term
+static void weightsOf(const Feature &feature, int phase, double &middlegame, double &endgame) {
+    double mg = static_cast<double>(phase) / ChessBoard::maxGamePhase;
+    switch (Parameters::kindOf(feature.term)) {
+        case Parameters::Flat:
+            middlegame = feature.coefficient;
+            endgame = 0;
+            break;
+        case Parameters::MiddlegameOnly:
+            middlegame = feature.coefficient * mg;
+            endgame = 0;
+            break;
+        default:
+            middlegame = feature.coefficient * mg;
+            endgame = feature.coefficient * (1 - mg);
+    }
+}
+
+class Tuner {
+public:
+    Tuner(std::vector<PackedPosition> positions, const EvalParams &fixedParams, int threads)
+            : positions(std::move(positions)), fixedParams(fixedParams), threads(std::max(1, threads)) {
+        for (int t = 0; t < this->threads; t++) boards.push_back(std::make_unique<ChessBoard>());
+    }
+
+    // Mean squared error of sigmoid(k * score) against the results, with the gradient when asked for
+    double error(const Parameters &parameters, double k, std::vector<double> *gradient) const {
+        std::vector<double> errors(threads, 0);
+        std::vector<std::vector<double>> gradients(threads);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t] {
+                std::vector<Feature> features;
+                ChessBoard *board = boards[t].get();
+                if (gradient) gradients[t].assign(parameters.values.size(), 0);
+                for (size_t i = t; i < positions.size(); i += threads) {
+                    uint64_t bitboards[12];
+                    unpack(positions[i], bitboards);
+                    setPieces(*board, bitboards);
+                    features.clear();
+                    addFeatures(*board, bitboards, fixedParams, features);
+                    int phase = phaseOf(bitboards);
+
+                    double score = 0;
+                    for (const Feature &feature: features) {
+                        double mg, eg;
+                        weightsOf(feature, phase, mg, eg);
+                        score += mg * parameters.values[2 * feature.term] + eg * parameters.values[2 * feature.term + 1];
+                    }
+                    double predicted = 1 / (1 + std::exp(-k * score));
+                    double difference = predicted - positions[i].result / 2.0;
+                    errors[t] += difference * difference;
+                    if (!gradient) continue;
+                    double slope = 2 * difference * predicted * (1 - predicted) * k;
+                    for (const Feature &feature: features) {
+                        double mg, eg;
+                        weightsOf(feature, phase, mg, eg);
+                        gradients[t][2 * feature.term] += slope * mg;
+                        gradients[t][2 * feature.term + 1] += slope * eg;
+                    }
+                }
+            });
+        }
+        for (auto &worker: workers) worker.join();
+
+        double total = 0;
+        for (double e: errors) total += e;
+        if (gradient) {
+            gradient->assign(parameters.values.size(), 0);
+            for (const auto &g: gradients) {
+                for (size_t j = 0; j < g.size(); j++) (*gradient)[j] += g[j] / positions.size();
+            }
+        }
+        return total / positions.size();
+    }
+
+    // The sigmoid scale that best fits the starting parameters, by golden section search
+    double fitK(const Parameters &parameters) const {
+        double low = 0.001, high = 1.0;
+        const double ratio = (std::sqrt(5.0) - 1) / 2;
+        for (int i = 0; i < 30; i++) {
+            double a = high - ratio * (high - low), b = low + ratio * (high - low);
+            if (error(parameters, a, nullptr) < error(parameters, b, nullptr)) high = b;
+            else low = a;
+        }
+        return (low + high) / 2;
+    }
+
+    // Adam over all weights
+    void tune(Parameters &parameters, double k, int epochs, double rate) const {
+        std::vector<double> gradient, m(parameters.values.size()), v(parameters.values.size());
+        const double beta1 = 0.9, beta2 = 0.999, epsilon = 1e-8;
+        for (int epoch = 1; epoch <= epochs; epoch++) {
+            double e = error(parameters, k, &gradient);
+            for (size_t j = 0; j < parameters.values.size(); j++) {
+                m[j] = beta1 * m[j] + (1 - beta1) * gradient[j];
+                v[j] = beta2 * v[j] + (1 - beta2) * gradient[j] * gradient[j];
+                double mHat = m[j] / (1 - std::pow(beta1, epoch));
+                double vHat = v[j] / (1 - std::pow(beta2, epoch));
+                parameters.values[j] -= rate * mHat / (std::sqrt(vHat) + epsilon);
+            }
+            if (epoch == 1 || epoch % 10 == 0 || epoch == epochs) {
+                std::cout << "epoch " << epoch << " error " << e << std::endl;
+            }
+        }
+    }
+
+private:
+    std::vector<PackedPosition> positions;
+    EvalParams fixedParams;
+    int threads;
+    std::vector<std::unique_ptr<ChessBoard>> boards; // one per worker, error() reuses them on every call
+};
+
+static void writeScore(std::ostream &out, const char *name, int score) {
+    out << "    int " << name << " = makeScore(" << middlegameScore(score) << ", " << endgameScore(score) << ");\n";
+}
+
+static void writeScores(std::ostream &out, const char *name, const int *scores, int count) {
+    out << "    int " << name << "[" << count << "] = {\n           ";
+    for (int i = 0; i < count; i++) {
+        out << " makeScore(" << middlegameScore(scores[i]) << ", " << endgameScore(scores[i]) << "),";
+    }
+    out << "\n    };\n";
+}
+
+static void writeTable(std::ostream &out, const char *name, const int *values) {
+    out << "    int " << name << "[64] = {\n";
+    for (int rank = 0; rank < 8; rank++) {
+        out << "           ";
+        for (int file = 0; file < 8; file++) out << " " << values[rank * 8 + file] << ",";
+        out << "\n";
+    }
+    out << "    };\n";
+}
+
+// The tuned weights as EvalParams member declarations
+static void writeDeclarations(std::ostream &out, const EvalParams &params) {
+    out << "    int pawnValue = " << params.pawnValue << ";\n    int knightValue = " << params.knightValue
+        << ";\n    int bishopValue = " << params.bishopValue << ";\n    int rookValue = " << params.rookValue
+        << ";\n    int queenValue = " << params.queenValue << ";\n";
+    writeTable(out, "pawnPositionalValue", params.pawnPositionalValue);
+    writeTable(out, "knightPositionalValue", params.knightPositionalValue);
+    writeTable(out, "bishopPositionalValue", params.bishopPositionalValue);
+    writeTable(out, "rookPositionalValue", params.rookPositionalValue);
+    writeTable(out, "queenPositionalValue", params.queenPositionalValue);
+    writeTable(out, "kingPositionalValue", params.kingPositionalValue);
+    writeTable(out, "pawnEndgameValue", params.pawnEndgameValue);
+    writeTable(out, "knightEndgameValue", params.knightEndgameValue);
+    writeTable(out, "bishopEndgameValue", params.bishopEndgameValue);
+    writeTable(out, "rookEndgameValue", params.rookEndgameValue);
+    writeTable(out, "queenEndgameValue", params.queenEndgameValue);
+    writeTable(out, "kingEndgameValue", params.kingEndgameValue);
+    writeScore(out, "doubledPawnPenalty", params.doubledPawnPenalty);
+    writeScore(out, "isolatedPawnPenalty", params.isolatedPawnPenalty);
+    writeScore(out, "backwardPawnPenalty", params.backwardPawnPenalty);
+    writeScores(out, "passedPawnBonus", params.passedPawnBonus, 8);
+    writeScores(out, "mobilityBonus", params.mobilityBonus, 6);
+    out << "    int kingDangerBonus[16] = {";
+    for (int i = 0; i < 16; i++) out << (i ? ", " : "") << params.kingDangerBonus[i];
+    out << "};\n";
+    writeScore(out, "hangingPiecePenalty", params.hangingPiecePenalty);
+    writeScore(out, "defendedPieceBonus", params.defendedPieceBonus);
+    writeScore(out, "threatenedByPawnPenalty", params.threatenedByPawnPenalty);
+    writeScore(out, "threatenedByMinorPenalty", params.threatenedByMinorPenalty);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: texeltune <positions file> [--threads N] [--epochs N] [--rate R] [--params file]"
+                     " [--out file] [--tables file]" << std::endl;
+        return 1;
+    }
+    int threads = static_cast<int>(std::thread::hardware_concurrency());
+    int epochs = 200;
+    double rate = 0.1;
+    EvalParams startParams = defaultEvalParams;
+    std::string outPath = "tuned.params";
+    std::string tablesPath = "tuned_tables.txt";
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        if (option == "--threads") threads = std::atoi(argv[i + 1]);
+        else if (option == "--epochs") epochs = std::atoi(argv[i + 1]);
+        else if (option == "--rate") rate = std::atof(argv[i + 1]);
+        else if (option == "--out") outPath = argv[i + 1];
+        else if (option == "--tables") tablesPath = argv[i + 1];
+        else if (option == "--params" && !startParams.load(argv[i + 1])) return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::ifstream in(argv[1]);
+    std::vector<PackedPosition> positions;
+    std::string line;
+    PackedPosition position{};
+    while (std::getline(in, line)) {
+        if (parsePosition(line, position)) positions.push_back(position);
+    }
+    positions.shrink_to_fit();
+    std::cout << "Loaded " << positions.size() << " positions ("
+              << positions.size() * sizeof(PackedPosition) / (1024 * 1024) << " MB) in "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+    if (positions.empty()) return 1;
+
+    Tuner tuner(std::move(positions), startParams, threads);
+    Parameters parameters = Parameters::from(startParams);
+    double k = tuner.fitK(parameters);
+    std::cout << "K " << k << ", starting error " << tuner.error(parameters, k, nullptr) << std::endl;
+    tuner.tune(parameters, k, epochs, rate);
+
+    EvalParams tuned = parameters.toEvalParams(startParams);
+    std::ofstream out(outPath);
+    tuned.write(out);
+    std::ofstream tables(tablesPath);
+    writeDeclarations(tables, tuned);
+    std::cout << "Wrote " << outPath << " and " << tablesPath << std::endl;
+    return 0;
+}